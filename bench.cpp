@@ -0,0 +1,1194 @@
+// Benchmark all the data structures and write the results as JSON.
+//
+//     g++ -O2 -pthread bench.cpp -o bench
+//     ./bench > results.json
+//
+// Options:
+//     --sizes 1000,100000   The numbers of keys to run with.
+//     --runs 7              Timed runs of every benchmark.
+//     --counters            Also count instructions, cache misses and branch
+//                           misses with perf_event_open (Linux only).
+//     --filter rb           Only run structures whose name contains rb.
+//
+// Every benchmark runs once to warm up and then --runs times. Every run
+// gives a time per operation, and the output has the median, the slowest
+// and the fastest of those.
+//
+// The keys come in four distributions: sorted, reverse sorted, uniform (a
+// random order) and zipf (random keys where a few are drawn very often).
+// Inserted keys are even, so looking up a key plus one always misses.
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <random>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "trees/bst.h"
+#include "trees/rb.h"
+#include "trees/llrb.h"
+#include "trees/bplus.h"
+#include "trees/compact_llrb.h"
+#include "trees/static_index.h"
+#include "trees/concurrent_rb.h"
+#include "trees/persistent_llrb.h"
+#include "lists/linked_list.h"
+#include "lists/unrolled_list.h"
+#include "lists/concurrent_queue.h"
+#include "lists/skip_list.h"
+#include "lists/cache.h"
+#include "heaps/heap.h"
+#include "heaps/indexed_heap.h"
+#include "heaps/pairing_heap.h"
+#include "heaps/multi_queue.h"
+#include "heaps/radix_heap.h"
+#include "heaps/top_k.h"
+#include "heaps/external_sort.h"
+
+using namespace std;
+
+// Hardware counters of the calling thread, through perf_event_open. They
+// are often not allowed, for example in containers, and then available()
+// is false and no counts are written.
+class Counters {
+    public:
+        static const int count = 3;
+
+        static const char * name(int i) {
+            static const char * names[count] = {
+                "instructions", "cache_misses", "branch_misses" };
+            return names[i];
+        };
+
+    private:
+        int fds[count];
+        bool opened = false;
+
+    public:
+        Counters(bool enabled) {
+            for (int i = 0; i < count; i++)
+                this->fds[i] = -1;
+#ifdef __linux__
+            if (!enabled)
+                return;
+            const unsigned long configs[count] = {
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_MISSES };
+            for (int i = 0; i < count; i++) {
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[i];
+                attr.disabled = i == 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                // The first counter leads the group, so they all count
+                // over exactly the same time.
+                this->fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1,
+                                       i == 0 ? -1 : this->fds[0], 0);
+                if (this->fds[i] < 0)
+                    return;
+            }
+            this->opened = true;
+#endif
+        };
+
+        Counters(const Counters &) = delete;
+        Counters & operator=(const Counters &) = delete;
+
+        ~Counters() {
+#ifdef __linux__
+            for (int i = 0; i < count; i++) {
+                if (this->fds[i] >= 0)
+                    close(this->fds[i]);
+            }
+#endif
+        };
+
+        bool available() {
+            return this->opened;
+        };
+
+        void start() {
+#ifdef __linux__
+            if (!this->opened)
+                return;
+            ioctl(this->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(this->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+        };
+
+        // Stops counting and adds the counts to counts.
+        void stop(double counts[]) {
+#ifdef __linux__
+            if (!this->opened)
+                return;
+            ioctl(this->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            for (int i = 0; i < count; i++) {
+                unsigned long long value = 0;
+                if (read(this->fds[i], &value, sizeof(value)) == sizeof(value))
+                    counts[i] += value;
+            }
+#endif
+        };
+};
+
+struct Options {
+    vector<long> sizes;
+    int runs = 7;
+    bool counters = false;
+    string filter;
+};
+
+// Times benchmarks and writes one JSON object per benchmark.
+class Bench {
+    private:
+        Options options;
+        Counters counters;
+        bool first = true;
+        // Results of the timed code go here so that it is not optimized
+        // away.
+        volatile long sink = 0;
+
+        static double median(vector<double> sorted) {
+            sort(sorted.begin(), sorted.end());
+            long n = sorted.size();
+            return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+        };
+
+    public:
+        Bench(const Options & options) : options(options), counters(options.counters) {
+            cout << "{" << endl;
+            cout << "  \"runs\": " << options.runs << "," << endl;
+            cout << "  \"counters\": " << (this->counters.available() ? "true" : "false")
+                 << "," << endl;
+            cout << "  \"results\": [";
+        };
+
+        ~Bench() {
+            cout << endl << "  ]" << endl << "}" << endl;
+        };
+
+        const Options & settings() {
+            return this->options;
+        };
+
+        // Returns true if the structure should be run.
+        bool wanted(const string & structure) {
+            return structure.find(this->options.filter) != string::npos;
+        };
+
+        // Runs reset() and then times run(), which does ops operations and
+        // returns any number. This is done once to warm up and then once
+        // for every timed run. If given, extra holds more numbers to write,
+        // and run() can fill it in.
+        template<class TReset, class TRun>
+        void measure(const string & structure, const string & operation,
+                     const string & distribution, long size, long ops,
+                     TReset reset, TRun run,
+                     const vector<pair<string, double> > * extra = NULL) {
+            vector<double> times;
+            double counts[Counters::count] = { 0 };
+            for (int r = -1; r < this->options.runs; r++) {
+                reset();
+                if (r >= 0)
+                    this->counters.start();
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                this->sink += run();
+                double ns = chrono::duration<double, nano>(
+                    chrono::steady_clock::now() - start).count();
+                if (r >= 0) {
+                    this->counters.stop(counts);
+                    times.push_back(ns / (ops > 0 ? ops : 1));
+                }
+            }
+
+            cout << (this->first ? "" : ",") << endl;
+            this->first = false;
+            cout << "    {\"structure\": \"" << structure << "\", \"operation\": \""
+                 << operation << "\", \"distribution\": \"" << distribution
+                 << "\", \"size\": " << size << ", \"ops\": " << ops
+                 << ", \"median_ns\": " << median(times)
+                 << ", \"max_ns\": " << *max_element(times.begin(), times.end())
+                 << ", \"min_ns\": " << *min_element(times.begin(), times.end());
+            if (this->counters.available()) {
+                double total = (double)this->options.runs * (ops > 0 ? ops : 1);
+                for (int i = 0; i < Counters::count; i++)
+                    cout << ", \"" << Counters::name(i) << "\": " << counts[i] / total;
+            }
+            for (size_t i = 0; extra && i < extra->size(); i++)
+                cout << ", \"" << (*extra)[i].first << "\": " << (*extra)[i].second;
+            cout << "}" << flush;
+        };
+};
+
+const char * distributions[] = { "sorted", "reverse", "uniform", "zipf" };
+
+// Returns n keys from the given distribution. All keys are even.
+vector<long> make_keys(const string & distribution, long n, mt19937_64 & random) {
+    vector<long> keys(n);
+    for (long i = 0; i < n; i++)
+        keys[i] = 2 * i;
+    if (distribution == "reverse")
+        reverse(keys.begin(), keys.end());
+    else if (distribution == "uniform")
+        shuffle(keys.begin(), keys.end(), random);
+    else if (distribution == "zipf") {
+        // Rank r is drawn with a chance proportional to 1 / (r + 1). The
+        // ranks are given to the keys in a random order, so the popular
+        // keys are spread out.
+        vector<long> order(keys);
+        shuffle(order.begin(), order.end(), random);
+        vector<double> cumulative(n);
+        double sum = 0;
+        for (long r = 0; r < n; r++) {
+            sum += 1.0 / (r + 1);
+            cumulative[r] = sum;
+        }
+        uniform_real_distribution<double> uniform(0, sum);
+        for (long i = 0; i < n; i++) {
+            long r = lower_bound(cumulative.begin(), cumulative.end(), uniform(random)) -
+                cumulative.begin();
+            keys[i] = order[r < n ? r : n - 1];
+        }
+    }
+    return keys;
+}
+
+// Benchmarks insert, lookup-hit, lookup-miss and a scan of all keys for a
+// tree with insert(key, value) and range_scan(). contains(tree, key) looks
+// up a key.
+template<class TTree, class TContains>
+void bench_tree(Bench & bench, const string & name, TContains contains) {
+    if (!bench.wanted(name))
+        return;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int d = 0; d < 4; d++) {
+            string distribution = distributions[d];
+            // A plain binary search tree turns into a list on sorted keys.
+            if (name == "bst" && d < 2 && n > 20000)
+                continue;
+            vector<long> keys = make_keys(distribution, n, random);
+            vector<long> queries = make_keys(distribution, n, random);
+            unique_ptr<TTree> tree;
+
+            bench.measure(name, "insert", distribution, n, n,
+                [&]() { tree.reset(new TTree()); },
+                [&]() {
+                    for (long i = 0; i < n; i++)
+                        tree->insert(keys[i], keys[i]);
+                    return tree->size();
+                });
+            bench.measure(name, "lookup_hit", distribution, n, n, [](){},
+                [&]() {
+                    long found = 0;
+                    for (long i = 0; i < n; i++)
+                        found += contains(*tree, queries[i]);
+                    return found;
+                });
+            bench.measure(name, "lookup_miss", distribution, n, n, [](){},
+                [&]() {
+                    long found = 0;
+                    for (long i = 0; i < n; i++)
+                        found += contains(*tree, queries[i] + 1);
+                    return found;
+                });
+            bench.measure(name, "scan", distribution, n, n, [](){},
+                [&]() {
+                    long sum = 0;
+                    tree->range_scan(numeric_limits<long>::min(), numeric_limits<long>::max(),
+                                     [&](long, long value) { sum += value; });
+                    return sum;
+                });
+        }
+    }
+}
+
+// Lookups in a static index. Building it from a red-black tree counts as
+// the insert.
+void bench_static_index(Bench & bench) {
+    string name = "static_index";
+    if (!bench.wanted(name))
+        return;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int d = 0; d < 4; d++) {
+            string distribution = distributions[d];
+            vector<long> keys = make_keys(distribution, n, random);
+            vector<long> queries = make_keys(distribution, n, random);
+            RB<long, long> source;
+            for (long i = 0; i < n; i++)
+                source.insert(keys[i], keys[i]);
+            StaticIndex<long, long> index;
+
+            bench.measure(name, "insert", distribution, n, n, [](){},
+                [&]() {
+                    index = StaticIndex<long, long>(source);
+                    return index.size();
+                });
+            bench.measure(name, "lookup_hit", distribution, n, n, [](){},
+                [&]() {
+                    long found = 0;
+                    for (long i = 0; i < n; i++)
+                        found += index.contains(queries[i]);
+                    return found;
+                });
+            bench.measure(name, "lookup_miss", distribution, n, n, [](){},
+                [&]() {
+                    long found = 0;
+                    for (long i = 0; i < n; i++)
+                        found += index.contains(queries[i] + 1);
+                    return found;
+                });
+            bench.measure(name, "scan", distribution, n, n, [](){},
+                [&]() {
+                    long sum = 0;
+                    index.range_scan(numeric_limits<long>::min(), numeric_limits<long>::max(),
+                                     [&](long, long value) { sum += value; });
+                    return sum;
+                });
+        }
+    }
+}
+
+long sum_list(LinkedList<long> & list) {
+    long sum = 0;
+    for (LinkedList<long>::iterator it = list.begin(); it != list.end(); ++it)
+        sum += *it;
+    return sum;
+}
+
+long sum_list(UnrolledList<long> & list) {
+    long sum = 0;
+    for (UnrolledList<long>::iterator it = list.begin(); it != list.end(); ++it)
+        sum += *it;
+    return sum;
+}
+
+// Lookups in a list are linear, so only a few of them are timed.
+template<class TList>
+void bench_list(Bench & bench, const string & name) {
+    if (!bench.wanted(name))
+        return;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        long lookups = min(n, 1000L);
+        for (int d = 0; d < 4; d++) {
+            string distribution = distributions[d];
+            vector<long> keys = make_keys(distribution, n, random);
+            vector<long> queries = make_keys(distribution, n, random);
+            unique_ptr<TList> list;
+
+            bench.measure(name, "insert", distribution, n, n,
+                [&]() { list.reset(new TList()); },
+                [&]() {
+                    for (long i = 0; i < n; i++)
+                        list->insert(keys[i]);
+                    return n;
+                });
+            bench.measure(name, "lookup_hit", distribution, n, lookups, [](){},
+                [&]() {
+                    long found = 0;
+                    for (long i = 0; i < lookups; i++)
+                        found += list->contains(queries[i]);
+                    return found;
+                });
+            bench.measure(name, "lookup_miss", distribution, n, lookups, [](){},
+                [&]() {
+                    long found = 0;
+                    for (long i = 0; i < lookups; i++)
+                        found += list->contains(queries[i] + 1);
+                    return found;
+                });
+            bench.measure(name, "scan", distribution, n, n, [](){},
+                [&]() { return sum_list(*list); });
+        }
+    }
+}
+
+// A LinkedList behind a mutex, to compare the lock-free queues with.
+class LockedQueue {
+    private:
+        LinkedList<long> list;
+        mutex lock;
+
+    public:
+        void push(long value) {
+            lock_guard<mutex> guard(this->lock);
+            this->list.insert(value);
+        };
+
+        bool try_pop(long & value) {
+            lock_guard<mutex> guard(this->lock);
+            if (this->list.empty())
+                return false;
+            value = this->list.front();
+            this->list.erase(this->list.begin());
+            return true;
+        };
+};
+
+// Producers push n timestamps in total and consumers pop them all, for a
+// few counts of producer and consumer threads. Time is per value, and the
+// median and 99th percentile time from push to pop of the last run are
+// written as latency. make() returns a new, empty queue.
+template<class TQueue, class TMake>
+void bench_queue(Bench & bench, const string & name, TMake make) {
+    if (!bench.wanted(name))
+        return;
+    const int threads[][2] = { {1, 1}, {2, 2}, {4, 4}, {1, 4}, {4, 1} };
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int t = 0; t < 5; t++) {
+            int producers = threads[t][0];
+            int consumers = threads[t][1];
+            ostringstream shape;
+            shape << producers << "p" << consumers << "c";
+            unique_ptr<TQueue> queue;
+            vector<vector<double> > latencies(consumers);
+            vector<pair<string, double> > extra;
+            bench.measure(name, "push_pop", shape.str(), n, n,
+                [&]() {
+                    queue.reset(make());
+                    for (int c = 0; c < consumers; c++) {
+                        latencies[c].clear();
+                        latencies[c].reserve(n);
+                    }
+                },
+                [&]() {
+                    atomic<long> popped(0);
+                    vector<thread> workers;
+                    for (int p = 0; p < producers; p++) {
+                        workers.push_back(thread([&, p]() {
+                            for (long i = p; i < n; i += producers)
+                                queue->push(chrono::steady_clock::now().time_since_epoch().count());
+                        }));
+                    }
+                    for (int c = 0; c < consumers; c++) {
+                        workers.push_back(thread([&, c]() {
+                            long pushed;
+                            while (popped.load(memory_order_relaxed) < n) {
+                                if (!queue->try_pop(pushed)) {
+                                    this_thread::yield();
+                                    continue;
+                                }
+                                long now = chrono::steady_clock::now().time_since_epoch().count();
+                                latencies[c].push_back(chrono::duration<double, nano>(
+                                    chrono::steady_clock::duration(now - pushed)).count());
+                                popped.fetch_add(1, memory_order_relaxed);
+                            }
+                        }));
+                    }
+                    for (size_t w = 0; w < workers.size(); w++)
+                        workers[w].join();
+                    vector<double> all;
+                    for (int c = 0; c < consumers; c++)
+                        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+                    sort(all.begin(), all.end());
+                    extra.clear();
+                    extra.push_back(make_pair(string("latency_median_ns"), all[all.size() / 2]));
+                    extra.push_back(make_pair(string("latency_p99_ns"),
+                                              all[(size_t)(0.99 * (all.size() - 1))]));
+                    return popped.load();
+                }, &extra);
+        }
+    }
+}
+
+// Lookups, inserts and erases of random keys from 1 to 64 threads at once,
+// 80% lookups and the rest split between inserts and erases. The map
+// starts with every other key. Time is per operation over all threads.
+// update(map, key, insert) puts in or takes out a key.
+template<class TMap, class TUpdate>
+void bench_concurrent_map(Bench & bench, const string & name, TUpdate update) {
+    if (!bench.wanted(name))
+        return;
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int threads = 1; threads <= 64; threads *= 2) {
+            unique_ptr<TMap> map;
+            vector<pair<string, double> > extra;
+            extra.push_back(make_pair(string("threads"), (double)threads));
+            bench.measure(name, "mixed", "uniform", n, n,
+                [&]() {
+                    map.reset(new TMap());
+                    for (long i = 0; i < n; i++)
+                        map->insert(2 * i, 2 * i);
+                },
+                [&]() {
+                    atomic<long> found(0);
+                    vector<thread> workers;
+                    for (int t = 0; t < threads; t++) {
+                        workers.push_back(thread([&, t]() {
+                            mt19937_64 random(t);
+                            long hits = 0;
+                            for (long i = t; i < n; i += threads) {
+                                long key = random() % (2 * n);
+                                int kind = random() % 10;
+                                if (kind < 8)
+                                    hits += map->contains(key);
+                                else
+                                    update(*map, key, kind == 8);
+                            }
+                            found += hits;
+                        }));
+                    }
+                    for (int t = 0; t < threads; t++)
+                        workers[t].join();
+                    return found.load();
+                }, &extra);
+        }
+    }
+}
+
+// Lookups of keys that are there from 1 to 8 reader threads, while one more
+// thread keeps putting in and taking out a key. Time is per lookup over all
+// readers, and the number of writes per lookup is written too.
+// update(map, key, insert) puts in or takes out a key.
+template<class TMap, class TUpdate>
+void bench_readers(Bench & bench, const string & name, TUpdate update) {
+    if (!bench.wanted(name))
+        return;
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int threads = 1; threads <= 8; threads *= 2) {
+            unique_ptr<TMap> map;
+            vector<pair<string, double> > extra;
+            bench.measure(name, "lookup_one_writer", "uniform", n, n,
+                [&]() {
+                    map.reset(new TMap());
+                    for (long i = 0; i < n; i++)
+                        map->insert(2 * i, 2 * i);
+                },
+                [&]() {
+                    atomic<bool> stop(false);
+                    atomic<long> found(0);
+                    long writes = 0;
+                    thread writer([&]() {
+                        while (!stop.load(memory_order_relaxed)) {
+                            update(*map, 1, true);
+                            update(*map, 1, false);
+                            writes += 2;
+                        }
+                    });
+                    vector<thread> readers;
+                    for (int t = 0; t < threads; t++) {
+                        readers.push_back(thread([&, t]() {
+                            mt19937_64 random(t);
+                            long hits = 0;
+                            for (long i = t; i < n; i += threads)
+                                hits += map->contains(2 * (long)(random() % n));
+                            found += hits;
+                        }));
+                    }
+                    for (int t = 0; t < threads; t++)
+                        readers[t].join();
+                    stop.store(true);
+                    writer.join();
+                    extra.clear();
+                    extra.push_back(make_pair(string("threads"), (double)threads));
+                    extra.push_back(make_pair(string("writes_per_lookup"), (double)writes / n));
+                    return found.load();
+                }, &extra);
+        }
+    }
+}
+
+// A least recently used cache made the usual way, out of a std::list and
+// a std::unordered_map, to compare Cache with.
+class StdLRUCache {
+    private:
+        typedef list<pair<long, long> > Order;
+
+        Order order;
+        unordered_map<long, Order::iterator> index;
+        size_t capacity;
+
+    public:
+        StdLRUCache(size_t capacity) : capacity(capacity) {};
+
+        long * get(long key) {
+            unordered_map<long, Order::iterator>::iterator it = this->index.find(key);
+            if (it == this->index.end())
+                return NULL;
+            this->order.splice(this->order.end(), this->order, it->second);
+            return &it->second->second;
+        };
+
+        void put(long key, long value) {
+            if (this->index.size() == this->capacity) {
+                this->index.erase(this->order.front().first);
+                this->order.pop_front();
+            }
+            this->order.push_back(make_pair(key, value));
+            this->index[key] = --this->order.end();
+        };
+};
+
+// A stream of Zipf-distributed keys through a cache with room for a tenth
+// of the keys, putting every key that misses. The cache is warmed up with
+// the same stream first. Time is per key, and the hit rate is written too.
+template<class TCache>
+void bench_cache(Bench & bench, const string & name) {
+    if (!bench.wanted(name))
+        return;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        vector<long> keys = make_keys("zipf", n, random);
+        unique_ptr<TCache> cache;
+        long hits = 0;
+        auto run = [&]() {
+            hits = 0;
+            for (long i = 0; i < n; i++) {
+                if (cache->get(keys[i]))
+                    hits++;
+                else
+                    cache->put(keys[i], keys[i]);
+            }
+            return hits;
+        };
+        vector<pair<string, double> > extra(1);
+        bench.measure(name, "get_or_put", "zipf", n, n,
+            [&]() {
+                cache.reset(new TCache(max(1L, n / 10)));
+                run();
+            },
+            [&]() {
+                run();
+                extra[0] = make_pair(string("hit_rate"), (double)hits / n);
+                return hits;
+            }, &extra);
+    }
+}
+
+// Pushes and heap sort for array heaps of the given arity.
+template<int D>
+void bench_array_heap(Bench & bench, const string & name) {
+    if (!bench.wanted(name))
+        return;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int d = 0; d < 4; d++) {
+            string distribution = distributions[d];
+            vector<long> keys = make_keys(distribution, n, random);
+            Heap<long, D> heap;
+
+            bench.measure(name, "insert", distribution, n, n,
+                [&]() { heap.clear(); },
+                [&]() {
+                    for (long i = 0; i < n; i++)
+                        heap.push(keys[i]);
+                    return heap.size();
+                });
+            bench.measure(name, "pop", distribution, n, n,
+                [&]() { heap = Heap<long, D>(keys.begin(), keys.end()); },
+                [&]() {
+                    long sum = 0;
+                    while (!heap.empty())
+                        sum += heap.pop();
+                    return sum;
+                });
+            bench.measure(name, "sort", distribution, n, n,
+                [&]() { heap = Heap<long, D>(keys.begin(), keys.end()); },
+                [&]() {
+                    heap.heapSort();
+                    return heap.size();
+                });
+            bench.measure(name, "sort_bottom_up", distribution, n, n,
+                [&]() { heap = Heap<long, D>(keys.begin(), keys.end()); },
+                [&]() {
+                    heap.bottomUpHeapSort();
+                    return heap.size();
+                });
+        }
+    }
+}
+
+// Pushes, and sorting by popping everything, for heaps made of nodes.
+template<class THeap>
+void bench_node_heap(Bench & bench, const string & name) {
+    if (!bench.wanted(name))
+        return;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int d = 0; d < 4; d++) {
+            string distribution = distributions[d];
+            vector<long> keys = make_keys(distribution, n, random);
+            unique_ptr<THeap> heap;
+
+            bench.measure(name, "insert", distribution, n, n,
+                [&]() { heap.reset(new THeap()); },
+                [&]() {
+                    for (long i = 0; i < n; i++)
+                        heap->push(keys[i]);
+                    return heap->size();
+                });
+            bench.measure(name, "sort", distribution, n, n,
+                [&]() {
+                    heap.reset(new THeap());
+                    for (long i = 0; i < n; i++)
+                        heap->push(keys[i]);
+                },
+                [&]() {
+                    long sum = 0;
+                    while (!heap->empty())
+                        sum += heap->pop();
+                    return sum;
+                });
+        }
+    }
+}
+
+// A Heap behind a mutex, to compare MultiQueue with.
+class LockedHeap {
+    private:
+        Heap<long> heap;
+        mutex lock;
+
+    public:
+        void push(long value) {
+            lock_guard<mutex> guard(this->lock);
+            this->heap.push(value);
+        };
+
+        bool try_pop(long & value) {
+            lock_guard<mutex> guard(this->lock);
+            if (this->heap.empty())
+                return false;
+            value = this->heap.pop();
+            return true;
+        };
+};
+
+// From 1 to 8 threads that each push a random value and then pop one, on a
+// queue that starts with n values. Time is per push and pop over all
+// threads. make(threads) returns a new, empty queue for that many threads.
+template<class TQueue, class TMake>
+void bench_concurrent_heap(Bench & bench, const string & name, TMake make) {
+    if (!bench.wanted(name))
+        return;
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int threads = 1; threads <= 8; threads *= 2) {
+            unique_ptr<TQueue> queue;
+            vector<pair<string, double> > extra;
+            extra.push_back(make_pair(string("threads"), (double)threads));
+            bench.measure(name, "push_pop", "uniform", n, n,
+                [&]() {
+                    queue.reset(make(threads));
+                    mt19937_64 random(n);
+                    for (long i = 0; i < n; i++)
+                        queue->push((long)(random() % n));
+                },
+                [&]() {
+                    atomic<long> sum(0);
+                    vector<thread> workers;
+                    for (int t = 0; t < threads; t++) {
+                        workers.push_back(thread([&, t]() {
+                            mt19937_64 random(t);
+                            long total = 0;
+                            long popped;
+                            for (long i = t; i < n; i += threads) {
+                                queue->push((long)(random() % n));
+                                if (queue->try_pop(popped))
+                                    total += popped;
+                            }
+                            sum += total;
+                        }));
+                    }
+                    for (int t = 0; t < threads; t++)
+                        workers[t].join();
+                    return sum.load();
+                }, &extra);
+        }
+    }
+}
+
+// std::sort, for comparison with the heap sorts.
+void bench_std_sort(Bench & bench) {
+    string name = "std_sort";
+    if (!bench.wanted(name))
+        return;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        for (int d = 0; d < 4; d++) {
+            string distribution = distributions[d];
+            vector<long> keys = make_keys(distribution, n, random);
+            vector<long> values;
+            bench.measure(name, "sort", distribution, n, n,
+                [&]() { values = keys; },
+                [&]() {
+                    sort(values.begin(), values.end());
+                    return values[0];
+                });
+        }
+    }
+}
+
+// Dijkstra from node 0 with a D-ary Heap and lazy deletion. Distances are
+// negated, since Heap is a max-heap.
+template<int D>
+long lazy_dijkstra(vector<vector<pair<long, long> > > & graph) {
+    vector<long> distance(graph.size(), 1L << 60);
+    Heap<pair<long, long>, D> frontier;
+    distance[0] = 0;
+    frontier.push(make_pair(0L, 0L));
+    while (!frontier.empty()) {
+        pair<long, long> top = frontier.pop();
+        long u = top.second;
+        if (-top.first > distance[u])
+            continue;
+        for (size_t e = 0; e < graph[u].size(); e++) {
+            long v = graph[u][e].first;
+            long d = distance[u] + graph[u][e].second;
+            if (d < distance[v]) {
+                distance[v] = d;
+                frontier.push(make_pair(-d, v));
+            }
+        }
+    }
+    return distance.back();
+}
+
+// Dijkstra on a random graph with 8 edges per node, with every priority
+// queue that fits. Time is per node.
+void bench_dijkstra(Bench & bench) {
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long nodes = sizes[s];
+        vector<vector<pair<long, long> > > graph(nodes);
+        for (long u = 0; u < nodes; u++) {
+            for (int e = 0; e < 8; e++)
+                graph[u].push_back(make_pair(random() % nodes, 1 + random() % 100000));
+        }
+
+        if (bench.wanted("heap2"))
+            bench.measure("heap2", "dijkstra", "random_graph", nodes, nodes, [](){},
+                [&]() { return lazy_dijkstra<2>(graph); });
+        if (bench.wanted("heap4"))
+            bench.measure("heap4", "dijkstra", "random_graph", nodes, nodes, [](){},
+                [&]() { return lazy_dijkstra<4>(graph); });
+        if (bench.wanted("radix_heap"))
+            bench.measure("radix_heap", "dijkstra", "random_graph", nodes, nodes, [](){},
+                [&]() {
+                    vector<long> distance(nodes, 1L << 60);
+                    RadixHeap<unsigned long, long> frontier;
+                    distance[0] = 0;
+                    frontier.push(0, 0);
+                    while (!frontier.empty()) {
+                        pair<unsigned long, long> top = frontier.pop();
+                        long u = top.second;
+                        if ((long)top.first > distance[u])
+                            continue;
+                        for (size_t e = 0; e < graph[u].size(); e++) {
+                            long v = graph[u][e].first;
+                            long d = distance[u] + graph[u][e].second;
+                            if (d < distance[v]) {
+                                distance[v] = d;
+                                frontier.push(d, v);
+                            }
+                        }
+                    }
+                    return distance.back();
+                });
+        if (bench.wanted("pairing_heap"))
+            bench.measure("pairing_heap", "dijkstra", "random_graph", nodes, nodes, [](){},
+                [&]() {
+                    vector<long> distance(nodes, 1L << 60);
+                    vector<PairingHeap<pair<long, long> >::Handle> in_queue(nodes, NULL);
+                    vector<bool> done(nodes, false);
+                    PairingHeap<pair<long, long> > frontier;
+                    distance[0] = 0;
+                    in_queue[0] = frontier.push(make_pair(0L, 0L));
+                    while (!frontier.empty()) {
+                        long u = frontier.pop().second;
+                        done[u] = true;
+                        for (size_t e = 0; e < graph[u].size(); e++) {
+                            long v = graph[u][e].first;
+                            long d = distance[u] + graph[u][e].second;
+                            if (done[v] || d >= distance[v])
+                                continue;
+                            distance[v] = d;
+                            if (in_queue[v])
+                                frontier.increase_key(in_queue[v], make_pair(-d, v));
+                            else
+                                in_queue[v] = frontier.push(make_pair(-d, v));
+                        }
+                    }
+                    return distance.back();
+                });
+    }
+}
+
+// Merging 100 heaps into one: meld against putting the arrays of array
+// heaps one after the other and building a heap of the whole array, in
+// linear time. Time is per value.
+void bench_meld(Bench & bench) {
+    const int shards = 100;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        if (bench.wanted("pairing_heap")) {
+            vector<unique_ptr<PairingHeap<long> > > parts;
+            unique_ptr<PairingHeap<long> > all;
+            bench.measure("pairing_heap", "meld", "uniform", n, n,
+                [&]() {
+                    parts.clear();
+                    for (int i = 0; i < shards; i++) {
+                        parts.push_back(unique_ptr<PairingHeap<long> >(new PairingHeap<long>()));
+                        for (long j = i; j < n; j += shards)
+                            parts[i]->push(random());
+                    }
+                    all.reset(new PairingHeap<long>());
+                },
+                [&]() {
+                    for (int i = 0; i < shards; i++)
+                        all->meld(*parts[i]);
+                    return all->size();
+                });
+        }
+        if (bench.wanted("heap2")) {
+            vector<vector<long> > parts;
+            vector<long> values;
+            bench.measure("heap2", "meld", "uniform", n, n,
+                [&]() {
+                    parts.assign(shards, vector<long>());
+                    for (int i = 0; i < shards; i++) {
+                        for (long j = i; j < n; j += shards)
+                            parts[i].push_back(random());
+                        Heap<long>(parts[i].data(), parts[i].size(), parts[i].size()).heapify();
+                    }
+                    values.clear();
+                    values.reserve(n);
+                },
+                [&]() {
+                    for (int i = 0; i < shards; i++)
+                        values.insert(values.end(), parts[i].begin(), parts[i].end());
+                    Heap<long> all(values.data(), values.size(), values.size());
+                    all.heapify();
+                    return all.size();
+                });
+        }
+    }
+}
+
+// The 1000 largest values of a stream, and a merge of 100 sorted runs.
+// Time is per value.
+void bench_selection(Bench & bench) {
+    if (!bench.wanted("top_k"))
+        return;
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        vector<long> stream = make_keys("uniform", n, random);
+        bench.measure("top_k", "select", "uniform", n, n, [](){},
+            [&]() {
+                TopK<long> top(1000);
+                top.push(stream.begin(), stream.end());
+                return top.threshold();
+            });
+
+        const int run_count = 100;
+        vector<vector<long> > runs(run_count);
+        for (long i = 0; i < n; i++)
+            runs[i % run_count].push_back(stream[i]);
+        for (int r = 0; r < run_count; r++)
+            sort(runs[r].begin(), runs[r].end());
+        bench.measure("top_k", "merge", "uniform", n, n, [](){},
+            [&]() {
+                KWayMerge<vector<long>::iterator> merge;
+                for (int r = 0; r < run_count; r++)
+                    merge.add(runs[r].begin(), runs[r].end());
+                long last = 0;
+                while (!merge.empty())
+                    last = merge.pop();
+                return last;
+            });
+    }
+}
+
+// Sorting a file of 100-byte records with an eighth of its size in memory.
+// Time is per record.
+void bench_external_sort(Bench & bench) {
+    if (!bench.wanted("external_sort"))
+        return;
+    const size_t record_size = 100;
+    string input = "/tmp/bench_external_sort_input";
+    string output = "/tmp/bench_external_sort_output";
+    mt19937_64 random(1);
+    const vector<long> & sizes = bench.settings().sizes;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        long n = sizes[s];
+        FILE * file = fopen(input.c_str(), "wb");
+        if (!file)
+            return;
+        vector<char> record(record_size);
+        for (long i = 0; i < n; i++) {
+            for (size_t b = 0; b < record_size; b++)
+                record[b] = random();
+            fwrite(record.data(), 1, record_size, file);
+        }
+        fclose(file);
+
+        ExternalSort sorter(record_size, max(n * record_size / 8, 4096UL));
+        sorter.fan_in(8);
+        // The stats of the last run, with its throughput.
+        vector<pair<string, double> > extra;
+        bench.measure("external_sort", "sort", "uniform", n, n, [](){},
+            [&]() {
+                ExternalSort::Stats stats = sorter.sort(input, output);
+                extra.clear();
+                extra.push_back(make_pair(string("sorted_runs"), (double)stats.runs));
+                extra.push_back(make_pair(string("passes"), (double)stats.passes));
+                extra.push_back(make_pair(string("mb_per_second"), stats.mb_per_second()));
+                return stats.records;
+            }, &extra);
+        remove(input.c_str());
+        remove(output.c_str());
+    }
+}
+
+bool contains_in_tree(Tree<long, long> & tree, long key) {
+    return tree.find(key) != tree.end();
+}
+
+int main(int argc, char ** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--sizes") {
+            istringstream is(value);
+            string size;
+            while (getline(is, size, ','))
+                options.sizes.push_back(atol(size.c_str()));
+            i++;
+        }
+        else if (arg == "--runs") {
+            options.runs = max(1, atoi(value.c_str()));
+            i++;
+        }
+        else if (arg == "--counters")
+            options.counters = true;
+        else if (arg == "--filter") {
+            options.filter = value;
+            i++;
+        }
+        else {
+            cerr << "Usage: " << argv[0]
+                 << " [--sizes 1000,100000] [--runs 7] [--counters] [--filter name]" << endl;
+            return 1;
+        }
+    }
+    if (options.sizes.empty()) {
+        options.sizes.push_back(1000);
+        options.sizes.push_back(100000);
+    }
+
+    Bench bench(options);
+    bench_tree<BST<long, long> >(bench, "bst", contains_in_tree);
+    bench_tree<RB<long, long> >(bench, "rb", contains_in_tree);
+    bench_tree<LLRB<long, long> >(bench, "llrb", contains_in_tree);
+    bench_tree<BPlusTree<long, long> >(bench, "bplus",
+        [](BPlusTree<long, long> & tree, long key) { return tree.contains(key); });
+    bench_tree<CompactLLRB<long, long> >(bench, "compact_llrb",
+        [](CompactLLRB<long, long> & tree, long key) { return tree.contains(key); });
+    bench_tree<ConcurrentRB<long, long> >(bench, "concurrent_rb",
+        [](ConcurrentRB<long, long> & tree, long key) { return tree.contains(key); });
+    bench_tree<PersistentLLRB<long, long> >(bench, "persistent_llrb",
+        [](PersistentLLRB<long, long> & tree, long key) { return tree.contains(key); });
+    bench_tree<SkipList<long, long> >(bench, "skip_list",
+        [](SkipList<long, long> & list, long key) { return list.contains(key); });
+    bench_tree<ConcurrentSkipList<long, long> >(bench, "concurrent_skip_list",
+        [](ConcurrentSkipList<long, long> & list, long key) { return list.contains(key); });
+    bench_static_index(bench);
+    bench_list<LinkedList<long> >(bench, "linked_list");
+    bench_list<UnrolledList<long> >(bench, "unrolled_list");
+    auto update_skip_list = [](ConcurrentSkipList<long, long> & map, long key, bool insert) {
+        if (insert)
+            map.insert(key, key);
+        else
+            map.erase(key);
+    };
+    // The red-black tree keeps repeated keys, so a key is only put in if it
+    // is not there yet.
+    auto update_rb = [](ConcurrentRB<long, long> & map, long key, bool insert) {
+        if (!insert)
+            map.erase(key);
+        else if (!map.contains(key))
+            map.insert(key, key);
+    };
+    bench_concurrent_map<ConcurrentSkipList<long, long> >(bench, "concurrent_skip_list",
+                                                          update_skip_list);
+    bench_concurrent_map<ConcurrentRB<long, long> >(bench, "concurrent_rb", update_rb);
+    bench_readers<ConcurrentSkipList<long, long> >(bench, "concurrent_skip_list",
+                                                   update_skip_list);
+    bench_readers<ConcurrentRB<long, long> >(bench, "concurrent_rb", update_rb);
+    bench_queue<BoundedQueue<long> >(bench, "bounded_queue",
+        []() { return new BoundedQueue<long>(1024); });
+    bench_queue<LinkedQueue<long> >(bench, "linked_queue",
+        []() { return new LinkedQueue<long>(); });
+    bench_queue<LockedQueue>(bench, "locked_list",
+        []() { return new LockedQueue(); });
+    bench_cache<Cache<long, long> >(bench, "lru_cache");
+    bench_cache<Cache<long, long, LEAST_FREQUENTLY_USED> >(bench, "lfu_cache");
+    bench_cache<StdLRUCache>(bench, "std_lru_cache");
+    bench_array_heap<2>(bench, "heap2");
+    bench_array_heap<4>(bench, "heap4");
+    bench_array_heap<8>(bench, "heap8");
+    bench_node_heap<PairingHeap<long> >(bench, "pairing_heap");
+    bench_node_heap<IndexedHeap<long> >(bench, "indexed_heap");
+    bench_concurrent_heap<MultiQueue<long> >(bench, "multi_queue",
+        [](int threads) { return new MultiQueue<long>(threads); });
+    bench_concurrent_heap<LockedHeap>(bench, "locked_heap",
+        [](int) { return new LockedHeap(); });
+    bench_std_sort(bench);
+    bench_dijkstra(bench);
+    bench_meld(bench);
+    bench_selection(bench);
+    bench_external_sort(bench);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Epoch-based reclamation for structures that are read without locks.
+//
+// Readers wrap every lock-free access in an Epoch::Guard. A thread that has
+// unlinked some nodes calls synchronize(), which returns once every reader
+// that could still be looking at those nodes has left its guard. After that
+// the nodes can be freed.
+//
+// Readers are counted in one of two sets of counters, depending on the parity
+// of the current epoch. synchronize() moves the epoch on and waits for the
+// counters of the old epoch to drain. The counters are spread over several
+// cache lines so readers on different threads rarely touch the same line.
+class Epoch {
+    private:
+        static const int stripes = 32;
+
+        struct alignas(64) Counter {
+            std::atomic<long> readers;
+        };
+
+        std::atomic<unsigned long> epoch;
+        Counter counters[2][stripes];
+        std::mutex mutex;
+
+        // Gives each thread its own stripe, round robin.
+        static int stripe() {
+            static std::atomic<int> next(0);
+            thread_local int mine = next.fetch_add(1) % stripes;
+            return mine;
+        };
+
+    public:
+        Epoch() : epoch(0) {
+            for (int i = 0; i < 2; i++) {
+                for (int j = 0; j < stripes; j++)
+                    counters[i][j].readers.store(0);
+            }
+        };
+
+        Epoch(const Epoch &) = delete;
+        Epoch & operator=(const Epoch &) = delete;
+
+        // Marks the current thread as a reader until the guard goes out of
+        // scope. Guards may not be held across a call to synchronize() on the
+        // same thread.
+        class Guard {
+            private:
+                std::atomic<long> * counter;
+
+            public:
+                Guard(Epoch & e) {
+                    int i = stripe();
+                    for (;;) {
+                        unsigned long current = e.epoch.load();
+                        counter = &e.counters[current & 1][i].readers;
+                        counter->fetch_add(1);
+                        // If the epoch moved on in the meantime, the thread
+                        // calling synchronize() may already have looked at
+                        // this counter, so try again.
+                        if (e.epoch.load() == current)
+                            break;
+                        counter->fetch_sub(1);
+                    }
+                };
+
+                ~Guard() {
+                    counter->fetch_sub(1, std::memory_order_release);
+                };
+
+                Guard(const Guard &) = delete;
+                Guard & operator=(const Guard &) = delete;
+        };
+
+        // Waits until every reader that entered a guard before this call has
+        // left it. Anything that was unlinked before the call can be freed
+        // afterwards.
+        void synchronize() {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            unsigned long old = this->epoch.load();
+            this->epoch.store(old + 1);
+            for (int i = 0; i < stripes; i++) {
+                while (this->counters[old & 1][i].readers.load() != 0)
+                    std::this_thread::yield();
+            }
+        };
+};
+
+// Nodes that were unlinked from a structure read under an Epoch, waiting to
+// be freed.
+//
+// Any thread can retire a node. Once about a batch of them has piled up,
+// the thread that retired the last one takes the whole list, waits for the
+// epoch to move past it and frees it with TDelete, while other threads go
+// on retiring into a new list. Nodes link up through a member
+// TNode * retired, so retiring allocates nothing.
+template<class TNode, class TDelete = std::default_delete<TNode> >
+class RetireList {
+    private:
+        // Nodes are freed in batches of about this many.
+        static const long batch = 256;
+
+        alignas(64) std::atomic<TNode *> nodes;
+        std::atomic<long> count;
+        std::atomic<bool> reclaiming;
+        Epoch & epoch;
+        TDelete destroy;
+
+    public:
+        RetireList(Epoch & epoch) : nodes(NULL), count(0), reclaiming(false), epoch(epoch) {};
+
+        RetireList(const RetireList &) = delete;
+        RetireList & operator=(const RetireList &) = delete;
+
+        ~RetireList() {
+            clear();
+        };
+
+        // Puts an unlinked node on the list, and frees the list if it has
+        // grown long enough. Must not be called inside a guard.
+        void retire(TNode * x) {
+            TNode * first = this->nodes.load(std::memory_order_relaxed);
+            do {
+                x->retired = first;
+            } while (!this->nodes.compare_exchange_weak(first, x,
+                         std::memory_order_release, std::memory_order_relaxed));
+            if (this->count.fetch_add(1, std::memory_order_relaxed) + 1 < batch ||
+                this->reclaiming.exchange(true, std::memory_order_acquire))
+                return;
+            // Only the nodes taken here are freed. They were all unlinked
+            // before the call to synchronize(), so once it returns, no
+            // thread can still be looking at them.
+            TNode * taken = this->nodes.exchange(NULL, std::memory_order_acquire);
+            this->epoch.synchronize();
+            long freed = 0;
+            while (taken) {
+                TNode * next = taken->retired;
+                this->destroy(taken);
+                taken = next;
+                freed++;
+            }
+            this->count.fetch_sub(freed, std::memory_order_relaxed);
+            this->reclaiming.store(false, std::memory_order_release);
+        };
+
+        // Frees every node on the list right away. No other thread may use
+        // the structure meanwhile.
+        void clear() {
+            TNode * x = this->nodes.exchange(NULL);
+            while (x) {
+                TNode * next = x->retired;
+                this->destroy(x);
+                x = next;
+            }
+            this->count.store(0);
+        };
+};
+
+#endif
@@ -0,0 +1,423 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _EXTERNAL_SORT_H_
+#define _EXTERNAL_SORT_H_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+#include <unistd.h>
+#include "heap.h"
+
+// Sorts a file of fixed-width records that does not fit in memory.
+//
+// The records are first read through a heap that fits in the given memory
+// and written out as sorted runs to temporary files. The heap uses
+// replacement selection: a record that is not smaller than the last one
+// written still joins the current run, so on random input the runs come out
+// about twice as long as the memory. The runs are then merged through a heap
+// of cursors, at most fanIn at a time, until one is left, which is written
+// to the output file. The first run is written next to the output file, so
+// if it turns out to be the only one, it is renamed to the output instead.
+// All reading and writing goes through large buffers.
+//
+// Records are compared byte by byte, like memcmp, on a key that is a range
+// of bytes in the record, by default the whole record.
+// Adapted from Knuth, The Art of Computer Programming, volume 3, section 5.4
+class ExternalSort {
+    public:
+        // What a call to sort() did.
+        struct Stats {
+            long records;
+            long runs;
+            // Times every record was read and written, including the
+            // pass that made the runs.
+            int passes;
+            long bytesRead;
+            long bytesWritten;
+            size_t recordSize;
+            double runSeconds;
+            double mergeSeconds;
+
+            // Throughput, as megabytes of input sorted per second.
+            double mb_per_second() const {
+                double seconds = this->runSeconds + this->mergeSeconds;
+                return seconds > 0 ? this->records * this->recordSize / 1e6 / seconds : 0;
+            };
+        };
+
+    private:
+        size_t recordSize;
+        size_t memory;
+        size_t keyOffset = 0;
+        size_t keyLength;
+        int fanIn = 64;
+        std::string tempDirectory = "/tmp";
+
+        long bytesRead;
+        long bytesWritten;
+
+        // Closes a file when its owner goes away, so no run is left open
+        // when a sort throws. The runs are unlinked as soon as they are
+        // made, so closing them also gives back their space.
+        struct FileClose {
+            void operator()(FILE * file) const {
+                fclose(file);
+            };
+        };
+
+        typedef std::unique_ptr<FILE, FileClose> File;
+        typedef std::vector<File> Files;
+
+        // Unlinks the file at path when it goes away, unless path is cleared
+        // first.
+        struct Unlink {
+            std::string path;
+
+            ~Unlink() {
+                if (!this->path.empty())
+                    unlink(this->path.c_str());
+            };
+        };
+
+        // Reads records from a file through a buffer.
+        class Reader {
+            private:
+                FILE * file;
+                std::vector<char> buffer;
+                size_t recordSize;
+                size_t position = 0;
+                size_t length = 0;
+                long * bytesRead;
+
+            public:
+                Reader(FILE * file, size_t recordSize, size_t bufferSize, long * bytesRead) :
+                    file(file), recordSize(recordSize), bytesRead(bytesRead) {
+                    // Whole records only, so no record is split between two
+                    // fills of the buffer.
+                    size_t records = bufferSize / recordSize;
+                    this->buffer.resize((records > 0 ? records : 1) * recordSize);
+                };
+
+                // Returns the next record, or NULL at the end of the file. The
+                // record stays valid until the next call. Throws if the file
+                // ends in the middle of a record.
+                const char * next() {
+                    if (this->position == this->length) {
+                        this->length = fread(&this->buffer[0], 1, this->buffer.size(), this->file);
+                        *this->bytesRead += this->length;
+                        if (this->length % this->recordSize != 0)
+                            throw std::runtime_error("ExternalSort: the input ends in the middle of a record");
+                        this->position = 0;
+                        if (this->length == 0)
+                            return NULL;
+                    }
+                    const char * record = &this->buffer[this->position];
+                    this->position += this->recordSize;
+                    return record;
+                };
+        };
+
+        // Writes records to a file through a buffer.
+        class Writer {
+            private:
+                FILE * file;
+                std::vector<char> buffer;
+                size_t length = 0;
+                long * bytesWritten;
+
+            public:
+                Writer(FILE * file, size_t recordSize, size_t bufferSize, long * bytesWritten) :
+                    file(file), bytesWritten(bytesWritten) {
+                    size_t records = bufferSize / recordSize;
+                    this->buffer.resize((records > 0 ? records : 1) * recordSize);
+                };
+
+                void write(const char * record, size_t size) {
+                    if (this->length + size > this->buffer.size())
+                        flush();
+                    memcpy(&this->buffer[this->length], record, size);
+                    this->length += size;
+                };
+
+                // Writes out what is in the buffer. Must be called before the
+                // writer goes away.
+                void flush() {
+                    if (this->length > 0 &&
+                        fwrite(&this->buffer[0], 1, this->length, this->file) != this->length)
+                        throw std::runtime_error("ExternalSort: write failed");
+                    *this->bytesWritten += this->length;
+                    this->length = 0;
+                };
+        };
+
+        // A record in the heap. The heap is a max-heap, so the comparison
+        // is turned around to take the smallest record first.
+        struct Entry {
+            const char * record;
+            // The run the record goes to while making runs. Records of a
+            // later run come out after all records of an earlier one.
+            long run;
+            // The run the record comes from while merging. Equal records
+            // come out in the order of their runs.
+            long source;
+            const ExternalSort * sorter;
+
+            bool operator>(const Entry & other) const {
+                if (this->run != other.run)
+                    return this->run < other.run;
+                int c = this->sorter->compare(this->record, other.record);
+                return c < 0 || (c == 0 && this->source < other.source);
+            };
+        };
+
+        int compare(const char * a, const char * b) const {
+            return memcmp(a + this->keyOffset, b + this->keyOffset, this->keyLength);
+        };
+
+        // Creates a new file with a name that starts with path, and puts the
+        // whole name in path.
+        static FILE * create(std::string & path) {
+            std::vector<char> name(path.begin(), path.end());
+            const char pattern[] = "XXXXXX";
+            name.insert(name.end(), pattern, pattern + sizeof(pattern));
+            int fd = mkstemp(&name[0]);
+            if (fd < 0)
+                throw std::runtime_error("ExternalSort: cannot create " + path + pattern);
+            path = &name[0];
+            FILE * file = fdopen(fd, "w+b");
+            if (!file) {
+                close(fd);
+                unlink(path.c_str());
+                throw std::runtime_error("ExternalSort: cannot open " + path);
+            }
+            return file;
+        };
+
+        // Opens a temporary file that is deleted once it is closed.
+        FILE * temporary() {
+            std::string path = this->tempDirectory + "/external_sort_";
+            FILE * file = create(path);
+            unlink(path.c_str());
+            return file;
+        };
+
+        // Reads the input and writes sorted runs with replacement selection
+        // into runs. The first run is written next to the output and its
+        // name is put in first, so that it can be renamed to the output if
+        // it turns out to be the only run. Otherwise it is unlinked like the
+        // other runs and first is cleared.
+        void make_runs(FILE * input, const std::string & output, long & records,
+                       std::string & first, Files & runs) {
+            // Half of the memory holds records, and the rest is shared by the
+            // heap and the buffers.
+            size_t capacity = this->memory / 2 / (this->recordSize + sizeof(Entry));
+            if (capacity < 1)
+                capacity = 1;
+            size_t bufferSize = this->memory / 8;
+            std::vector<char> arena(capacity * this->recordSize);
+            Heap<Entry> heap;
+            heap.reserve(capacity);
+
+            Reader reader(input, this->recordSize, bufferSize, &this->bytesRead);
+            const char * record;
+            for (size_t i = 0; i < capacity && (record = reader.next()); i++) {
+                char * slot = &arena[i * this->recordSize];
+                memcpy(slot, record, this->recordSize);
+                heap.push(Entry{slot, 0, 0, this});
+            }
+
+            std::unique_ptr<Writer> writer;
+            long run = -1;
+            records = 0;
+            while (!heap.empty()) {
+                Entry smallest = heap.top();
+                if (smallest.run != run) {
+                    if (writer)
+                        writer->flush();
+                    if (runs.empty()) {
+                        std::string path = output + ".run_";
+                        runs.push_back(File(create(path)));
+                        first = path;
+                    }
+                    else {
+                        if (runs.size() == 1) {
+                            unlink(first.c_str());
+                            first.clear();
+                        }
+                        runs.push_back(File(temporary()));
+                    }
+                    writer.reset(new Writer(runs.back().get(), this->recordSize, bufferSize,
+                                            &this->bytesWritten));
+                    run = smallest.run;
+                }
+                writer->write(smallest.record, this->recordSize);
+                records++;
+                // The slot of the record that was written takes the next
+                // record of the input. If it is smaller than the one just
+                // written, it has to wait for the next run.
+                char * slot = const_cast<char *>(smallest.record);
+                if ((record = reader.next())) {
+                    bool later = this->compare(record, slot) < 0;
+                    memcpy(slot, record, this->recordSize);
+                    heap.replace(Entry{slot, later ? run + 1 : run, 0, this});
+                }
+                else
+                    heap.pop();
+            }
+            if (writer)
+                writer->flush();
+            if (ferror(input))
+                throw std::runtime_error("ExternalSort: read failed");
+        };
+
+        // Merges the given runs into output.
+        void merge(Files & runs, FILE * output) {
+            size_t bufferSize = this->memory / (runs.size() + 1);
+            std::vector<Reader> readers;
+            readers.reserve(runs.size());
+            Heap<Entry> heap;
+            for (size_t i = 0; i < runs.size(); i++) {
+                rewind(runs[i].get());
+                readers.push_back(Reader(runs[i].get(), this->recordSize, bufferSize,
+                                         &this->bytesRead));
+                const char * record = readers[i].next();
+                if (record)
+                    heap.push(Entry{record, 0, (long)i, this});
+            }
+            {
+                Writer writer(output, this->recordSize, bufferSize, &this->bytesWritten);
+                while (!heap.empty()) {
+                    Entry smallest = heap.top();
+                    writer.write(smallest.record, this->recordSize);
+                    const char * record = readers[smallest.source].next();
+                    if (record)
+                        heap.replace(Entry{record, 0, smallest.source, this});
+                    else
+                        heap.pop();
+                }
+                writer.flush();
+            }
+        };
+
+        // Makes the only run the output. It is sorted already, so it is
+        // renamed rather than merged. Clears first once it is renamed.
+        void rename_run(File & run, Unlink & first, const std::string & output) {
+            if (fclose(run.release()) != 0 ||
+                rename(first.path.c_str(), output.c_str()) != 0)
+                throw std::runtime_error("ExternalSort: cannot write " + output);
+            first.path.clear();
+        };
+
+        // Merges fanIn runs at a time into longer runs until the rest can
+        // be merged into the output in one go. Adds a pass for every round.
+        // Every run is closed as soon as it has been merged.
+        void merge_runs(Files & runs, const std::string & output, int & passes) {
+            while ((long)runs.size() > this->fanIn) {
+                Files merged;
+                for (size_t i = 0; i < runs.size(); i += this->fanIn) {
+                    size_t end = i + this->fanIn < runs.size() ? i + this->fanIn : runs.size();
+                    Files group;
+                    for (size_t j = i; j < end; j++)
+                        group.push_back(std::move(runs[j]));
+                    merged.push_back(File(this->temporary()));
+                    this->merge(group, merged.back().get());
+                    fflush(merged.back().get());
+                }
+                runs = std::move(merged);
+                passes++;
+            }
+            File out(fopen(output.c_str(), "wb"));
+            if (!out)
+                throw std::runtime_error("ExternalSort: cannot open " + output);
+            this->merge(runs, out.get());
+            runs.clear();
+            if (fclose(out.release()) != 0)
+                throw std::runtime_error("ExternalSort: cannot write " + output);
+            passes++;
+        };
+
+    public:
+        // Constructor.
+        // Sorts records of recordSize bytes using about memory bytes.
+        ExternalSort(size_t recordSize, size_t memory = 64 << 20) :
+            recordSize(recordSize), memory(memory), keyLength(recordSize) {};
+
+        // Compares records on length bytes starting at offset.
+        void key(size_t offset, size_t length) {
+            this->keyOffset = offset;
+            this->keyLength = length;
+        };
+
+        // Sets the most runs that are merged at a time.
+        void fan_in(int runs) {
+            this->fanIn = runs > 1 ? runs : 2;
+        };
+
+        // Sets where the runs are written.
+        void temp_directory(const std::string & directory) {
+            this->tempDirectory = directory;
+        };
+
+        // Sorts the records in the file input into the file output.
+        // O(n log n) comparisons and O(log_fanIn(runs)) passes over the data.
+        Stats sort(const std::string & input, const std::string & output) {
+            Stats stats = Stats();
+            stats.recordSize = this->recordSize;
+            this->bytesRead = 0;
+            this->bytesWritten = 0;
+
+            File in(fopen(input.c_str(), "rb"));
+            if (!in)
+                throw std::runtime_error("ExternalSort: cannot open " + input);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            // The runs are closed, and the first one unlinked, whichever
+            // way this returns.
+            Files runs;
+            Unlink first;
+            this->make_runs(in.get(), output, stats.records, first.path, runs);
+            in.reset();
+            std::chrono::steady_clock::time_point made = std::chrono::steady_clock::now();
+            stats.runs = runs.size();
+            stats.passes = 1;
+
+            if (!first.path.empty())
+                this->rename_run(runs[0], first, output);
+            else
+                this->merge_runs(runs, output, stats.passes);
+
+            stats.runSeconds = std::chrono::duration<double>(made - start).count();
+            stats.mergeSeconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - made).count();
+            stats.bytesRead = this->bytesRead;
+            stats.bytesWritten = this->bytesWritten;
+            return stats;
+        };
+};
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _INDEXED_HEAP_H_
+#define _INDEXED_HEAP_H_
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <utility>
+#include "../util.h"
+
+// A max-heap where every value gets a handle when it is pushed. The handle
+// stays the same while the value moves around in the heap, and can be used
+// to change the value or remove it.
+//
+// Next to the heap array there is a table from handles to positions in the
+// array, which is updated whenever a value moves. Handles of removed values
+// are given out again by later pushes.
+// Based on the index priority queue in Sedgewick, Algorithms, section 2.4
+template<class TValue>
+class IndexedHeap {
+    private:
+        struct Entry {
+            TValue value;
+            long handle;
+        };
+
+        std::vector<Entry> heap;
+        // The position of every handle in the heap, or -1 if it is free.
+        std::vector<long> position;
+        std::vector<long> freeHandles;
+
+        long parent(long i) {
+            return (i-1)/2;
+        };
+
+        // Puts the entry at index i, and tells its handle where it is.
+        void place(long i, Entry && entry) {
+            this->position[entry.handle] = i;
+            this->heap[i] = std::move(entry);
+        };
+
+        // Moves the entry at index i up until its parent is not smaller.
+        void siftUp(long i) {
+            Entry entry = std::move(this->heap[i]);
+            while (i > 0 && entry.value > this->heap[this->parent(i)].value) {
+                this->place(i, std::move(this->heap[this->parent(i)]));
+                i = this->parent(i);
+            }
+            this->place(i, std::move(entry));
+        };
+
+        // Moves the entry at index i down until no child is larger.
+        void siftDown(long i) {
+            Entry entry = std::move(this->heap[i]);
+            long n = this->heap.size();
+            for (;;) {
+                long c = 2*i+1;
+                if (c >= n)
+                    break;
+                c += c+1 < n && this->heap[c+1].value > this->heap[c].value;
+                if (!(this->heap[c].value > entry.value))
+                    break;
+                this->place(i, std::move(this->heap[c]));
+                i = c;
+            }
+            this->place(i, std::move(entry));
+        };
+
+        // Takes the entry at index i out of the heap and frees its handle.
+        TValue remove(long i) {
+            Entry entry = std::move(this->heap[i]);
+            this->position[entry.handle] = -1;
+            this->freeHandles.push_back(entry.handle);
+            long last = this->heap.size() - 1;
+            if (i != last) {
+                this->place(i, std::move(this->heap[last]));
+                this->heap.pop_back();
+                // The entry from the end can be larger or smaller than the
+                // one it replaces.
+                if (i > 0 && this->heap[i].value > this->heap[this->parent(i)].value)
+                    this->siftUp(i);
+                else
+                    this->siftDown(i);
+            }
+            else
+                this->heap.pop_back();
+            return std::move(entry.value);
+        };
+
+    public:
+        // Adds a value and returns its handle.
+        // Logarithmic time, O(log n).
+        long push(TValue value) {
+            long handle;
+            if (!this->freeHandles.empty()) {
+                handle = this->freeHandles.back();
+                this->freeHandles.pop_back();
+            }
+            else {
+                handle = this->position.size();
+                this->position.push_back(-1);
+            }
+            this->heap.push_back(Entry{std::move(value), handle});
+            this->siftUp(this->heap.size() - 1);
+            return handle;
+        };
+
+        // Returns the largest value. The heap must not be empty.
+        // Constant time, O(1).
+        const TValue & top() {
+            return this->heap[0].value;
+        };
+
+        // Returns the handle of the largest value.
+        long top_handle() {
+            return this->heap[0].handle;
+        };
+
+        // Removes and returns the largest value.
+        // Logarithmic time, O(log n).
+        TValue pop() {
+            return this->remove(0);
+        };
+
+        // Returns true if the handle belongs to a value in the heap.
+        bool contains(long handle) {
+            return handle >= 0 && handle < (long)this->position.size() &&
+                this->position[handle] >= 0;
+        };
+
+        // Returns the value with the given handle.
+        // Constant time, O(1).
+        const TValue & value(long handle) {
+            return this->heap[this->position[handle]].value;
+        };
+
+        // Gives the value with the given handle a larger value.
+        // Logarithmic time, O(log n).
+        void increase_key(long handle, TValue value) {
+            long i = this->position[handle];
+            this->heap[i].value = std::move(value);
+            this->siftUp(i);
+        };
+
+        // Gives the value with the given handle a smaller value.
+        // Logarithmic time, O(log n).
+        void decrease_key(long handle, TValue value) {
+            long i = this->position[handle];
+            this->heap[i].value = std::move(value);
+            this->siftDown(i);
+        };
+
+        // Changes the value with the given handle in either direction.
+        // Logarithmic time, O(log n).
+        void update(long handle, TValue value) {
+            long i = this->position[handle];
+            bool larger = value > this->heap[i].value;
+            this->heap[i].value = std::move(value);
+            if (larger)
+                this->siftUp(i);
+            else
+                this->siftDown(i);
+        };
+
+        // Removes the value with the given handle and returns it.
+        // Logarithmic time, O(log n).
+        TValue erase(long handle) {
+            return this->remove(this->position[handle]);
+        };
+
+        // Makes room for n values without growing again.
+        void reserve(long n) {
+            this->heap.reserve(n);
+            this->position.reserve(n);
+        };
+
+        long size() {
+            return this->heap.size();
+        };
+
+        bool empty() {
+            return this->heap.empty();
+        };
+
+        // Removes all values. All handles become free.
+        void clear() {
+            this->heap.clear();
+            this->position.clear();
+            this->freeHandles.clear();
+        };
+
+        // Returns a string with all values in heap order.
+        std::string printHeap() {
+            std::ostringstream os;
+            for (size_t i = 0; i < this->heap.size(); i++)
+                os << to_string(this->heap[i].value) << std::endl;
+            return os.str();
+        };
+};
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _MULTI_QUEUE_H_
+#define _MULTI_QUEUE_H_
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "heap.h"
+
+// A priority queue for many threads that gives up strict ordering to scale.
+//
+// The values are spread over many small heaps, each behind its own spin
+// lock, with a few heaps per thread. push() puts a value into a random heap.
+// pop() looks at two random heaps and takes the larger top of the two. A
+// popped value is then not always the largest one in the queue, but close
+// to it: on average it is a small number of places from the top, and that
+// number depends on the number of heaps, not on the number of values.
+//
+// Threads only wait when they pick a heap that another thread holds, and
+// then they pick again instead of waiting.
+// Adapted from Rihani et. al., MultiQueues: Simple Relaxed Concurrent
+// Priority Queues
+template<class TValue, int D = 2>
+class MultiQueue {
+    private:
+        struct alignas(64) Shard {
+            std::atomic<bool> locked;
+            Heap<TValue, D> heap;
+
+            Shard() : locked(false) {};
+
+            bool try_lock() {
+                return !this->locked.load(std::memory_order_relaxed) &&
+                    !this->locked.exchange(true, std::memory_order_acquire);
+            };
+
+            void lock() {
+                while (!this->try_lock())
+                    std::this_thread::yield();
+            };
+
+            void unlock() {
+                this->locked.store(false, std::memory_order_release);
+            };
+        };
+
+        Shard * shards;
+        long count;
+        std::atomic<long> values;
+
+        // Returns a random shard. Every thread has its own generator.
+        long pick() {
+            thread_local unsigned long state = 0x9e3779b97f4a7c15UL ^
+                (unsigned long)std::hash<std::thread::id>()(std::this_thread::get_id());
+            // xorshift64
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state % this->count;
+        };
+
+    public:
+        // Constructor.
+        // Makes perThread heaps for each of the given number of threads.
+        MultiQueue(int threads, int perThread = 2) : values(0) {
+            this->count = threads * perThread > 1 ? threads * perThread : 2;
+            this->shards = new Shard[this->count];
+        };
+
+        MultiQueue(const MultiQueue &) = delete;
+        MultiQueue & operator=(const MultiQueue &) = delete;
+
+        ~MultiQueue() {
+            delete[] this->shards;
+        };
+
+        // Adds a value.
+        // Logarithmic time in the size of one heap.
+        void push(TValue value) {
+            Shard * s;
+            do {
+                s = &this->shards[pick()];
+            } while (!s->try_lock());
+            s->heap.push(std::move(value));
+            s->unlock();
+            this->values.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        // Removes one of the largest values and puts it in value. Returns
+        // false if the queue was found to be empty.
+        // Logarithmic time in the size of one heap.
+        bool try_pop(TValue & value) {
+            // Two random heaps, a few times, before looking at all of them.
+            for (int attempt = 0; attempt < 8; attempt++) {
+                if (this->values.load(std::memory_order_relaxed) == 0)
+                    return false;
+                long i = pick();
+                long j = pick();
+                if (i == j || !this->shards[i].try_lock())
+                    continue;
+                if (!this->shards[j].try_lock()) {
+                    this->shards[i].unlock();
+                    continue;
+                }
+                Heap<TValue, D> & a = this->shards[i].heap;
+                Heap<TValue, D> & b = this->shards[j].heap;
+                bool found = !a.empty() || !b.empty();
+                if (found) {
+                    if (b.empty() || (!a.empty() && !(b.top() > a.top())))
+                        value = a.pop();
+                    else
+                        value = b.pop();
+                }
+                this->shards[j].unlock();
+                this->shards[i].unlock();
+                if (found) {
+                    this->values.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            // The two heaps kept being empty or busy, so go through all of
+            // them in order.
+            for (long i = 0; i < this->count; i++) {
+                Shard & s = this->shards[i];
+                s.lock();
+                if (!s.heap.empty()) {
+                    value = s.heap.pop();
+                    s.unlock();
+                    this->values.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+                s.unlock();
+            }
+            return false;
+        };
+
+        // Returns the number of values. Only exact when no other thread is
+        // pushing or popping.
+        long size() {
+            return this->values.load(std::memory_order_relaxed);
+        };
+
+        bool empty() {
+            return size() == 0;
+        };
+};
+
+#endif
@@ -0,0 +1,250 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _PAIRING_HEAP_H_
+#define _PAIRING_HEAP_H_
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include "../util.h"
+#include "../pool.h"
+
+// A max-heap made of nodes, where two heaps are merged in constant time.
+//
+// Every node keeps its children in a list, the largest value is at the root,
+// and two heaps are merged by making the root with the smaller value the
+// first child of the other. Removing the root merges its children in pairs
+// from left to right, and then merges the pairs from right to left.
+//
+// push() returns a handle to the node of the value, which stays valid until
+// the value is removed, and can be used to make the value larger or to
+// remove it.
+// Adapted from Fredman et. al., The pairing heap: A new form of
+// self-adjusting heap
+template<class TValue>
+class PairingHeap {
+    private:
+        struct Node {
+            TValue value;
+            Node * child;
+            Node * sibling;
+            // The parent for the first child, otherwise the left sibling.
+            Node * prev;
+
+            Node(TValue && value) : value(std::move(value)), child(NULL),
+                sibling(NULL), prev(NULL) {};
+        };
+
+        NodePool<Node> pool;
+        Node * root = NULL;
+        long count = 0;
+
+        // Merges two trees whose roots have no siblings.
+        // Constant time, O(1).
+        static Node * link(Node * a, Node * b) {
+            if (b->value > a->value)
+                std::swap(a, b);
+            b->prev = a;
+            b->sibling = a->child;
+            if (a->child)
+                a->child->prev = b;
+            a->child = b;
+            return a;
+        };
+
+        // Merges a list of siblings into one tree, in two passes.
+        static Node * combine(Node * first) {
+            if (!first)
+                return NULL;
+            // Merge the siblings in pairs, keeping the pairs in a list in
+            // reverse order.
+            Node * pairs = NULL;
+            while (first) {
+                Node * a = first;
+                Node * b = a->sibling;
+                first = b ? b->sibling : NULL;
+                a->sibling = NULL;
+                if (b) {
+                    b->sibling = NULL;
+                    a = link(a, b);
+                }
+                a->prev = pairs;
+                pairs = a;
+            }
+            // Merge the pairs from the last one to the first one. The list
+            // of pairs runs through prev.
+            Node * result = pairs;
+            pairs = pairs->prev;
+            while (pairs) {
+                Node * next = pairs->prev;
+                result = link(result, pairs);
+                pairs = next;
+            }
+            result->prev = NULL;
+            return result;
+        };
+
+        // Unlinks x and its subtree from its parent and siblings.
+        static void cut(Node * x) {
+            if (x->prev->child == x)
+                x->prev->child = x->sibling;
+            else
+                x->prev->sibling = x->sibling;
+            if (x->sibling)
+                x->sibling->prev = x->prev;
+            x->sibling = NULL;
+            x->prev = NULL;
+        };
+
+    public:
+        typedef Node * Handle;
+
+        PairingHeap() {};
+
+        PairingHeap(const PairingHeap &) = delete;
+        PairingHeap & operator=(const PairingHeap &) = delete;
+
+        ~PairingHeap() {
+            clear();
+        };
+
+        // Adds a value and returns a handle to it.
+        // Constant time, O(1).
+        Handle push(TValue value) {
+            Node * x = this->pool.create(std::move(value));
+            this->root = this->root ? link(this->root, x) : x;
+            this->count++;
+            return x;
+        };
+
+        // Returns the largest value. The heap must not be empty.
+        // Constant time, O(1).
+        const TValue & top() {
+            return this->root->value;
+        };
+
+        // Removes and returns the largest value. The heap must not be empty.
+        // Amortized logarithmic time, O(log n).
+        TValue pop() {
+            Node * x = this->root;
+            TValue value = std::move(x->value);
+            this->root = combine(x->child);
+            this->pool.destroy(x);
+            this->count--;
+            return value;
+        };
+
+        // Returns the value of the given handle.
+        const TValue & value(Handle x) {
+            return x->value;
+        };
+
+        // Gives the value of the given handle a value that is not smaller.
+        // Constant time, O(1), and makes later pops slightly slower.
+        void increase_key(Handle x, TValue value) {
+            x->value = std::move(value);
+            if (x != this->root) {
+                cut(x);
+                this->root = link(this->root, x);
+            }
+        };
+
+        // Removes the value of the given handle and returns it.
+        // Amortized logarithmic time, O(log n).
+        TValue erase(Handle x) {
+            if (x == this->root)
+                return pop();
+            cut(x);
+            TValue value = std::move(x->value);
+            Node * children = combine(x->child);
+            if (children)
+                this->root = link(this->root, children);
+            this->pool.destroy(x);
+            this->count--;
+            return value;
+        };
+
+        // Moves all values of other into this heap and leaves other empty.
+        // Handles into other stay valid and now belong to this heap.
+        // Constant time in the number of values, O(1), plus the number of
+        // memory slabs other has, which grows logarithmically.
+        void meld(PairingHeap & other) {
+            if (this == &other || !other.root)
+                return;
+            this->pool.adopt(other.pool);
+            this->root = this->root ? link(this->root, other.root) : other.root;
+            this->count += other.count;
+            other.root = NULL;
+            other.count = 0;
+        };
+
+        long size() {
+            return this->count;
+        };
+
+        bool empty() {
+            return this->count == 0;
+        };
+
+        // Removes all values and gives the memory back.
+        // Linear time, O(n), unless TValue needs no destructor.
+        void clear() {
+            if (!std::is_trivially_destructible<TValue>::value && this->root) {
+                std::vector<Node *> stack(1, this->root);
+                while (!stack.empty()) {
+                    Node * x = stack.back();
+                    stack.pop_back();
+                    if (x->child)
+                        stack.push_back(x->child);
+                    if (x->sibling)
+                        stack.push_back(x->sibling);
+                    x->~Node();
+                }
+            }
+            this->pool.clear();
+            this->root = NULL;
+            this->count = 0;
+        };
+
+        // Returns a string with all values, parents before their children.
+        std::string printHeap() {
+            std::ostringstream os;
+            std::vector<Node *> stack;
+            if (this->root)
+                stack.push_back(this->root);
+            while (!stack.empty()) {
+                Node * x = stack.back();
+                stack.pop_back();
+                os << to_string(x->value) << std::endl;
+                if (x->sibling)
+                    stack.push_back(x->sibling);
+                if (x->child)
+                    stack.push_back(x->child);
+            }
+            return os.str();
+        };
+};
+
+#endif
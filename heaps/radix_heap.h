@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _RADIX_HEAP_H_
+#define _RADIX_HEAP_H_
+
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <stdexcept>
+
+// A min-heap for unsigned integer keys where the popped keys never go
+// down, such as the distances in Dijkstra's algorithm or the times in an
+// event simulation.
+//
+// The heap remembers the last key it popped. A key goes into the bucket
+// given by the highest bit in which it differs from that key, and bucket 0
+// holds the keys that are equal to it. Keys never have to be compared to
+// each other to find their bucket. When bucket 0 runs out, the first bucket
+// that is not empty is emptied into the lower buckets, using its smallest
+// key as the new last key. Every key can only move down, so it moves at
+// most once per bit.
+// Amortized O(log C) per value, where C is the largest key.
+// Adapted from Ahuja et. al., Faster Algorithms for the Shortest Path
+// Problem
+template<class TKey, class TValue>
+class RadixHeap {
+    static_assert(std::is_unsigned<TKey>::value, "RadixHeap needs unsigned keys");
+
+    private:
+        static const int bits = sizeof(TKey) * 8;
+
+        std::vector<std::pair<TKey, TValue> > buckets[bits + 1];
+        TKey last = 0;
+        long count = 0;
+
+        // Returns the bucket of the given key, one more than the highest bit
+        // in which it differs from the last key, or 0 if it does not differ.
+        int bucket(TKey key) {
+            TKey differ = key ^ this->last;
+            if (differ == 0)
+                return 0;
+            return (int)sizeof(unsigned long long) * 8 -
+                __builtin_clzll((unsigned long long)differ);
+        };
+
+        // Makes sure that bucket 0 has the smallest keys.
+        void pull() {
+            if (!this->buckets[0].empty())
+                return;
+            int i = 1;
+            while (this->buckets[i].empty())
+                i++;
+            std::vector<std::pair<TKey, TValue> > & from = this->buckets[i];
+            TKey smallest = from[0].first;
+            for (size_t j = 1; j < from.size(); j++) {
+                if (from[j].first < smallest)
+                    smallest = from[j].first;
+            }
+            this->last = smallest;
+            // All keys in bucket i agree with the new last key above bit
+            // i-1, so they all land in lower buckets.
+            for (size_t j = 0; j < from.size(); j++)
+                this->buckets[this->bucket(from[j].first)].push_back(std::move(from[j]));
+            from.clear();
+        };
+
+    public:
+        // Adds a value with the given key. The key must not be smaller than
+        // the last key that was popped or looked at with top().
+        // Constant time, O(1).
+        void push(TKey key, TValue value) {
+            if (key < this->last)
+                throw std::invalid_argument("RadixHeap: key is smaller than the last key");
+            this->buckets[this->bucket(key)].push_back(std::make_pair(key, std::move(value)));
+            this->count++;
+        };
+
+        // Returns the smallest key. The heap must not be empty.
+        // Amortized O(log C).
+        TKey top_key() {
+            this->pull();
+            return this->buckets[0].back().first;
+        };
+
+        // Returns a value with the smallest key. The heap must not be empty.
+        // Amortized O(log C).
+        const TValue & top() {
+            this->pull();
+            return this->buckets[0].back().second;
+        };
+
+        // Removes and returns a key and value with the smallest key. The
+        // heap must not be empty.
+        // Amortized O(log C).
+        std::pair<TKey, TValue> pop() {
+            this->pull();
+            std::pair<TKey, TValue> top = std::move(this->buckets[0].back());
+            this->buckets[0].pop_back();
+            this->count--;
+            return top;
+        };
+
+        // Returns the smallest key that can be pushed.
+        TKey last_key() {
+            return this->last;
+        };
+
+        long size() {
+            return this->count;
+        };
+
+        bool empty() {
+            return this->count == 0;
+        };
+
+        // Removes all values and starts over from key 0.
+        void clear() {
+            for (int i = 0; i <= bits; i++)
+                this->buckets[i].clear();
+            this->last = 0;
+            this->count = 0;
+        };
+};
+
+#endif
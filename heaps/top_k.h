@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _TOP_K_H_
+#define _TOP_K_H_
+
+#include <vector>
+#include <iterator>
+#include <utility>
+#include "heap.h"
+
+// Wraps a value so that a Heap of them is a min-heap. Heap only compares
+// with >, which this turns around.
+template<class TValue>
+struct Smallest {
+    TValue value;
+
+    Smallest(TValue value) : value(std::move(value)) {};
+
+    bool operator>(const Smallest & other) const {
+        return other.value > this->value;
+    };
+};
+
+// Keeps the k largest values of a stream that is too long to keep.
+//
+// The values kept so far are in a min-heap of size k, so the smallest of
+// them is at the top. A new value only goes in if it is larger than that
+// one, which it then replaces. Once the stream has gone on for a while,
+// almost every value is smaller and costs a single comparison.
+// Memory is O(k).
+template<class TValue, int D = 2>
+class TopK {
+    private:
+        long k;
+        Heap<Smallest<TValue>, D> heap;
+
+    public:
+        // Constructor.
+        // Keeps the k largest values.
+        TopK(long k) : k(k) {
+            this->heap.reserve(k);
+        };
+
+        // Offers one value.
+        // Constant time if the value is not among the k largest so far,
+        // otherwise logarithmic time, O(log k).
+        void push(const TValue & value) {
+            if (this->heap.size() < this->k)
+                this->heap.push(Smallest<TValue>(value));
+            else if (this->k > 0 && value > this->heap.top().value)
+                this->heap.replace(Smallest<TValue>(value));
+        };
+
+        // Offers the values in [first, last).
+        // The values are first checked against the smallest kept value in a
+        // tight loop, and only the few that beat it touch the heap.
+        template<class TIterator>
+        void push(TIterator first, TIterator last) {
+            for (; first != last && this->heap.size() < this->k; ++first)
+                this->heap.push(Smallest<TValue>(*first));
+            if (this->k == 0)
+                return;
+            const TValue * threshold = &this->heap.top().value;
+            for (; first != last; ++first) {
+                if (*first > *threshold) {
+                    this->heap.replace(Smallest<TValue>(*first));
+                    threshold = &this->heap.top().value;
+                }
+            }
+        };
+
+        // Returns the smallest of the kept values. Values that are not
+        // larger than this one are not kept. There must be k values kept.
+        const TValue & threshold() {
+            return this->heap.top().value;
+        };
+
+        // Returns the kept values, largest first.
+        // O(k log k).
+        std::vector<TValue> values() {
+            Heap<Smallest<TValue>, D> sorted(this->heap);
+            std::vector<TValue> result;
+            result.reserve(sorted.size());
+            while (!sorted.empty())
+                result.push_back(sorted.pop().value);
+            return std::vector<TValue>(result.rbegin(), result.rend());
+        };
+
+        // Returns the number of values kept, which is at most k.
+        long size() {
+            return this->heap.size();
+        };
+
+        void clear() {
+            this->heap.clear();
+        };
+};
+
+// Merges sorted sequences into one sorted sequence.
+//
+// Every sequence is given as a pair of input iterators, so they can be
+// arrays, containers or streams. A min-heap holds one cursor per sequence,
+// ordered by the value the cursor is at. Taking a value moves the top
+// cursor on and sifts it down once. Equal values come out in the order the
+// sequences were added.
+// Memory is O(k) for k sequences.
+template<class TIterator>
+class KWayMerge {
+    private:
+        typedef typename std::iterator_traits<TIterator>::value_type TValue;
+
+        struct Cursor {
+            TIterator current;
+            TIterator end;
+            long source;
+
+            // Reversed, so the heap keeps the smallest value at the top.
+            bool operator>(const Cursor & other) const {
+                if (*other.current > *this->current)
+                    return true;
+                if (*this->current > *other.current)
+                    return false;
+                return this->source < other.source;
+            };
+        };
+
+        Heap<Cursor> heap;
+        long sources = 0;
+
+    public:
+        // Adds a sorted sequence [first, last).
+        // Logarithmic time, O(log k).
+        void add(TIterator first, TIterator last) {
+            if (first != last)
+                this->heap.push(Cursor{first, last, this->sources});
+            this->sources++;
+        };
+
+        // Returns true when every sequence has run out.
+        bool empty() {
+            return this->heap.empty();
+        };
+
+        // Returns the next value. The merge must not be empty.
+        // Constant time, O(1).
+        const TValue & top() {
+            return *this->heap.top().current;
+        };
+
+        // Takes the next value and moves on.
+        // Logarithmic time, O(log k).
+        TValue pop() {
+            Cursor cursor = this->heap.top();
+            TValue value = *cursor.current;
+            ++cursor.current;
+            if (cursor.current != cursor.end)
+                this->heap.replace(std::move(cursor));
+            else
+                this->heap.pop();
+            return value;
+        };
+
+        // Writes all values to out in order and returns out.
+        template<class TOutput>
+        TOutput merge(TOutput out) {
+            while (!this->empty())
+                *out++ = this->pop();
+            return out;
+        };
+};
+
+#endif
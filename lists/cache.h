@@ -0,0 +1,424 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <functional>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include "intrusive_list.h"
+
+// Which entry a Cache gives up when it is full.
+enum CachePolicy {
+    // The entry that was used longest ago.
+    LEAST_RECENTLY_USED,
+    // The entry that was used the fewest times, and of those the one that
+    // was used longest ago.
+    LEAST_FREQUENTLY_USED
+};
+
+// A map of limited size that forgets entries to make room for new ones.
+//
+// The entries are kept in IntrusiveLists in the order they will be evicted,
+// and found through an open-addressing hash index that points into them, so
+// get, put and eviction are all constant time, O(1). For the least recently
+// used policy there is one list and a used entry moves to its back. For the
+// least frequently used policy there is one list per use count, and the
+// lists are themselves kept in a list ordered by count, so a used entry
+// moves from one list to the next.
+//
+// Everything is allocated up front: the entries, the hash slots and the
+// count lists. A full cache reuses the entry it evicts, so once it is warm
+// it does not allocate, except for what assigning keys and values needs.
+//
+// The size of the cache is limited both by the number of entries and by the
+// total bytes of the entries, where the bytes of an entry are given by the
+// caller.
+// Adapted from Shah et. al., An O(1) algorithm for implementing the LFU
+// cache eviction scheme
+template<class TKey, class TValue, CachePolicy Policy = LEAST_RECENTLY_USED,
+         class THash = std::hash<TKey> >
+class Cache {
+    public:
+        struct Stats {
+            long hits;
+            long misses;
+            long evictions;
+
+            double hit_rate() const {
+                long lookups = this->hits + this->misses;
+                return lookups > 0 ? (double)this->hits / lookups : 0;
+            };
+        };
+
+    private:
+        struct Bucket;
+
+        struct Entry {
+            TKey key;
+            TValue value;
+            size_t bytes = 0;
+            // The hash of the key, so the entry can be found again in the
+            // index without hashing the key.
+            uint32_t hash = 0;
+            // The list of entries with the same use count, if the policy
+            // counts them.
+            Bucket * bucket = NULL;
+            // Links the entry into the eviction order, or the free entries.
+            IntrusiveListHook hook;
+        };
+
+        typedef IntrusiveList<Entry, offsetof(Entry, hook)> EntryList;
+
+        // The entries that have been used the same number of times.
+        struct Bucket {
+            long count = 0;
+            EntryList entries;
+            // Links the bucket into the buckets in use, or the free ones.
+            IntrusiveListHook hook;
+        };
+
+        typedef IntrusiveList<Bucket, offsetof(Bucket, hook)> BucketList;
+
+        // A slot of the hash index. entry is the index of the entry plus
+        // one, or 0 if the slot is empty.
+        struct Slot {
+            uint32_t entry;
+            uint32_t hash;
+        };
+
+        // The lists unlink what is left in them when they are destroyed, so
+        // every list is declared after the array it links into.
+        THash hasher;
+        long capacity;
+        size_t maxBytes;
+        size_t usedBytes = 0;
+        std::unique_ptr<Entry[]> entries;
+        std::unique_ptr<Slot[]> slots;
+        size_t mask;
+        // Entries in the order they are evicted, for the least recently used
+        // policy, and the entries that are not in use.
+        EntryList order;
+        EntryList freeEntries;
+        // Buckets by increasing count, for the least frequently used policy,
+        // and the buckets that are not in use. There can never be more
+        // buckets in use than entries.
+        std::unique_ptr<Bucket[]> buckets;
+        BucketList counts;
+        BucketList freeBuckets;
+        Stats counters = Stats();
+
+        // Mixes the hash of the key so that keys that are close together
+        // do not end up in neighbouring slots.
+        uint32_t hash_of(const TKey & key) {
+            return (uint32_t)(((uint64_t)this->hasher(key) * 0x9E3779B97F4A7C15UL) >> 32);
+        };
+
+        // Returns the slot with the given key, or the empty slot where it
+        // would go.
+        size_t probe(const TKey & key, uint32_t hash) {
+            size_t i = hash & this->mask;
+            while (this->slots[i].entry) {
+                if (this->slots[i].hash == hash &&
+                    this->entries[this->slots[i].entry - 1].key == key)
+                    return i;
+                i = (i + 1) & this->mask;
+            }
+            return i;
+        };
+
+        // Empties slot i and moves later slots of the same run back, so
+        // lookups never need to skip deleted slots.
+        // Adapted from Knuth, The Art of Computer Programming, volume 3,
+        // section 6.4, algorithm R
+        void unindex(size_t i) {
+            for (;;) {
+                this->slots[i].entry = 0;
+                size_t j = i;
+                for (;;) {
+                    j = (j + 1) & this->mask;
+                    if (!this->slots[j].entry)
+                        return;
+                    // The entry at j can fill the hole at i unless its home
+                    // slot lies cyclically in (i, j].
+                    size_t home = this->slots[j].hash & this->mask;
+                    if (i <= j ? (home <= i || home > j) : (home <= i && home > j))
+                        break;
+                }
+                this->slots[i] = this->slots[j];
+                i = j;
+            }
+        };
+
+        // Moves the entry one step on in the eviction order after it has
+        // been used.
+        void touch(Entry & e) {
+            if (Policy == LEAST_RECENTLY_USED) {
+                this->order.move_to_back(e);
+                return;
+            }
+            Bucket * b = e.bucket;
+            typename BucketList::iterator next = this->counts.iterator_to(*b);
+            ++next;
+            Bucket * nb;
+            if (next != this->counts.end() && next->count == b->count + 1)
+                nb = &*next;
+            else if (b->entries.size() == 1) {
+                // e is alone, so its bucket can just count one more. This
+                // also means a full cache never needs more buckets than
+                // entries.
+                b->count++;
+                return;
+            }
+            else {
+                nb = &this->freeBuckets.pop_front();
+                nb->count = b->count + 1;
+                this->counts.insert_after(this->counts.iterator_to(*b), *nb);
+            }
+            b->entries.erase(e);
+            nb->entries.push_back(e);
+            e.bucket = nb;
+            if (b->entries.empty()) {
+                this->counts.erase(*b);
+                this->freeBuckets.push_back(*b);
+            }
+        };
+
+        // Puts a new entry at the start of the eviction order.
+        void link(Entry & e) {
+            if (Policy == LEAST_RECENTLY_USED) {
+                this->order.push_back(e);
+                return;
+            }
+            Bucket * b;
+            if (!this->counts.empty() && this->counts.front().count == 1)
+                b = &this->counts.front();
+            else {
+                b = &this->freeBuckets.pop_front();
+                b->count = 1;
+                this->counts.push_front(*b);
+            }
+            b->entries.push_back(e);
+            e.bucket = b;
+        };
+
+        void unlink(Entry & e) {
+            if (Policy == LEAST_RECENTLY_USED) {
+                this->order.erase(e);
+                return;
+            }
+            Bucket * b = e.bucket;
+            b->entries.erase(e);
+            e.bucket = NULL;
+            if (b->entries.empty()) {
+                this->counts.erase(*b);
+                this->freeBuckets.push_back(*b);
+            }
+        };
+
+        // Returns the entry that is evicted next, other than keep. There
+        // must be such an entry.
+        Entry & victim(Entry * keep = NULL) {
+            if (Policy == LEAST_RECENTLY_USED) {
+                typename EntryList::iterator it = this->order.begin();
+                if (&*it == keep)
+                    ++it;
+                return *it;
+            }
+            typename BucketList::iterator b = this->counts.begin();
+            typename EntryList::iterator it = b->entries.begin();
+            if (&*it == keep && ++it == b->entries.end())
+                it = (++b)->entries.begin();
+            return *it;
+        };
+
+        // Takes e out of the cache and gives it back to the free entries.
+        void remove(Entry & e) {
+            unindex(probe(e.key, e.hash));
+            unlink(e);
+            this->usedBytes -= e.bytes;
+            e.bytes = 0;
+            this->freeEntries.push_front(e);
+        };
+
+    public:
+        // Constructor.
+        // Room for the given number of entries is allocated right away. The
+        // entries together can be at most bytes big.
+        Cache(long capacity, size_t bytes = std::numeric_limits<size_t>::max()) :
+            capacity(capacity), maxBytes(bytes) {
+            if (capacity < 1 || capacity > std::numeric_limits<int32_t>::max() / 2)
+                throw std::invalid_argument("Cache capacity out of range");
+            this->entries.reset(new Entry[capacity]);
+            for (long i = 0; i < capacity; i++)
+                this->freeEntries.push_back(this->entries[i]);
+            // The index is at most half full.
+            size_t size = 2;
+            while (size < 2 * (size_t)capacity)
+                size *= 2;
+            this->mask = size - 1;
+            this->slots.reset(new Slot[size]());
+            if (Policy == LEAST_FREQUENTLY_USED) {
+                this->buckets.reset(new Bucket[capacity]);
+                for (long i = 0; i < capacity; i++)
+                    this->freeBuckets.push_back(this->buckets[i]);
+            }
+        };
+
+        // The lists point into the arrays, so the cache cannot be copied.
+        Cache(const Cache &) = delete;
+        Cache & operator=(const Cache &) = delete;
+
+        // Returns a pointer to the value of the key, or NULL if it is not
+        // in the cache, and counts a hit or a miss. A hit counts as a use
+        // of the entry. The pointer is good until the next put() or erase().
+        // Constant time, O(1).
+        TValue * get(const TKey & key) {
+            size_t i = probe(key, hash_of(key));
+            if (!this->slots[i].entry) {
+                this->counters.misses++;
+                return NULL;
+            }
+            this->counters.hits++;
+            Entry & e = this->entries[this->slots[i].entry - 1];
+            touch(e);
+            return &e.value;
+        };
+
+        // Returns true if the key is in the cache, without using it or
+        // counting anything.
+        // Constant time, O(1).
+        bool contains(const TKey & key) {
+            return this->slots[probe(key, hash_of(key))].entry != 0;
+        };
+
+        // Puts the key in the cache with the given value and size in bytes,
+        // or replaces the value if the key is there already, which counts as
+        // a use. Entries are evicted until the new one fits. Returns false,
+        // and leaves the key out, if it is bigger than the whole cache.
+        // Constant time, O(1), for every entry that is evicted.
+        bool put(const TKey & key, const TValue & value, size_t bytes) {
+            uint32_t hash = hash_of(key);
+            size_t i = probe(key, hash);
+            if (this->slots[i].entry) {
+                Entry & e = this->entries[this->slots[i].entry - 1];
+                if (bytes > this->maxBytes) {
+                    remove(e);
+                    return false;
+                }
+                this->usedBytes -= e.bytes;
+                e.value = value;
+                e.bytes = bytes;
+                this->usedBytes += bytes;
+                touch(e);
+                while (this->usedBytes > this->maxBytes) {
+                    this->counters.evictions++;
+                    remove(victim(&e));
+                }
+                return true;
+            }
+            if (bytes > this->maxBytes)
+                return false;
+            bool moved = false;
+            while (this->freeEntries.empty() || this->usedBytes + bytes > this->maxBytes) {
+                this->counters.evictions++;
+                remove(victim());
+                moved = true;
+            }
+            // Evicting may have moved slots around.
+            if (moved)
+                i = probe(key, hash);
+            Entry & e = this->freeEntries.pop_front();
+            e.key = key;
+            e.value = value;
+            e.bytes = bytes;
+            e.hash = hash;
+            this->usedBytes += bytes;
+            this->slots[i].entry = (uint32_t)(&e - this->entries.get()) + 1;
+            this->slots[i].hash = hash;
+            link(e);
+            return true;
+        };
+
+        // Puts the key in the cache, counting the size of the key and value
+        // types as its bytes.
+        bool put(const TKey & key, const TValue & value) {
+            return put(key, value, sizeof(TKey) + sizeof(TValue));
+        };
+
+        // Takes the key out of the cache. Returns false if it is not there.
+        // Constant time, O(1).
+        bool erase(const TKey & key) {
+            size_t i = probe(key, hash_of(key));
+            if (!this->slots[i].entry)
+                return false;
+            remove(this->entries[this->slots[i].entry - 1]);
+            return true;
+        };
+
+        // Takes everything out of the cache. The counters are kept.
+        // Linear time, O(n).
+        void clear() {
+            while (!empty())
+                remove(victim());
+        };
+
+        // Returns the key that is evicted next. The cache must not be empty.
+        const TKey & next_victim() {
+            return victim().key;
+        };
+
+        long size() {
+            return this->capacity - this->freeEntries.size();
+        };
+
+        bool empty() {
+            return size() == 0;
+        };
+
+        // Returns the total bytes of the entries in the cache.
+        size_t bytes() {
+            return this->usedBytes;
+        };
+
+        long max_entries() {
+            return this->capacity;
+        };
+
+        size_t max_bytes() {
+            return this->maxBytes;
+        };
+
+        Stats stats() {
+            return this->counters;
+        };
+
+        void reset_stats() {
+            this->counters = Stats();
+        };
+};
+
+#endif
@@ -0,0 +1,286 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _CONCURRENT_QUEUE_H_
+#define _CONCURRENT_QUEUE_H_
+
+#include <atomic>
+#include <thread>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include "../epoch.h"
+
+// A first-in first-out queue of fixed capacity for many producer and many
+// consumer threads, without locks.
+//
+// The values live in a ring of cells. Every cell has a sequence number that
+// says whether it is ready to be written or read in the current lap around
+// the ring. A producer claims the cell at the tail position by moving the
+// position on with a compare-and-swap, writes the value and then publishes
+// it by bumping the sequence number, and consumers do the same at the head.
+// Threads only contend on the two positions, and a value is never copied
+// more than once in and once out.
+// Adapted from Vyukov, Bounded MPMC queue
+template<class TValue>
+class BoundedQueue {
+    private:
+        struct alignas(64) Cell {
+            std::atomic<size_t> sequence;
+            alignas(TValue) unsigned char storage[sizeof(TValue)];
+
+            TValue * value() {
+                return reinterpret_cast<TValue *>(this->storage);
+            };
+        };
+
+        Cell * cells;
+        size_t mask;
+        // The two positions are on cache lines of their own, so producers
+        // and consumers do not slow each other down.
+        alignas(64) std::atomic<size_t> tail;
+        alignas(64) std::atomic<size_t> head;
+
+    public:
+        // Constructor.
+        // The capacity is rounded up to a power of two.
+        BoundedQueue(size_t capacity) : tail(0), head(0) {
+            size_t size = 2;
+            while (size < capacity)
+                size *= 2;
+            this->mask = size - 1;
+            this->cells = new Cell[size];
+            for (size_t i = 0; i < size; i++)
+                this->cells[i].sequence.store(i, std::memory_order_relaxed);
+        };
+
+        BoundedQueue(const BoundedQueue &) = delete;
+        BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+        // No other thread may use the queue any more.
+        ~BoundedQueue() {
+            size_t end = this->tail.load();
+            for (size_t i = this->head.load(); i != end; i++)
+                this->cells[i & this->mask].value()->~TValue();
+            delete[] this->cells;
+        };
+
+        // Adds a value at the tail. Returns false if the queue is full.
+        // Constant time, O(1), unless other threads keep winning the race.
+        bool try_push(TValue value) {
+            size_t position = this->tail.load(std::memory_order_relaxed);
+            Cell * cell;
+            for (;;) {
+                cell = &this->cells[position & this->mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                long difference = (long)sequence - (long)position;
+                if (difference == 0) {
+                    if (this->tail.compare_exchange_weak(position, position + 1,
+                                                         std::memory_order_relaxed))
+                        break;
+                }
+                else if (difference < 0)
+                    return false;
+                else
+                    position = this->tail.load(std::memory_order_relaxed);
+            }
+            new (cell->storage) TValue(std::move(value));
+            cell->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        };
+
+        // Adds a value at the tail, waiting for room if the queue is full.
+        void push(TValue value) {
+            while (!try_push(value))
+                std::this_thread::yield();
+        };
+
+        // Removes the value at the head and puts it in value. Returns false
+        // if the queue is empty.
+        // Constant time, O(1), unless other threads keep winning the race.
+        bool try_pop(TValue & value) {
+            size_t position = this->head.load(std::memory_order_relaxed);
+            Cell * cell;
+            for (;;) {
+                cell = &this->cells[position & this->mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                long difference = (long)sequence - (long)(position + 1);
+                if (difference == 0) {
+                    if (this->head.compare_exchange_weak(position, position + 1,
+                                                         std::memory_order_relaxed))
+                        break;
+                }
+                else if (difference < 0)
+                    return false;
+                else
+                    position = this->head.load(std::memory_order_relaxed);
+            }
+            value = std::move(*cell->value());
+            cell->value()->~TValue();
+            // The cell is ready for the producer one lap later.
+            cell->sequence.store(position + this->mask + 1, std::memory_order_release);
+            return true;
+        };
+
+        // Returns the number of values. Only exact when no other thread is
+        // pushing or popping.
+        long size() {
+            return (long)(this->tail.load() - this->head.load());
+        };
+
+        bool empty() {
+            return size() <= 0;
+        };
+
+        size_t capacity() {
+            return this->mask + 1;
+        };
+};
+
+// A first-in first-out queue without a bound for many producer and many
+// consumer threads, without locks.
+//
+// The values are in a singly linked list that starts with a dummy node. A
+// producer links a new node after the last one with a compare-and-swap and
+// then moves the tail pointer on, and any thread that finds the tail behind
+// helps move it. A consumer moves the head pointer to the next node, which
+// becomes the new dummy, and takes its value.
+//
+// Other threads can still be looking at a node that a consumer has just
+// unlinked, so it is not freed right away. Every operation runs inside an
+// Epoch guard, and unlinked nodes are collected until there are enough of
+// them. Then one thread waits for the epoch to move past all of them and
+// frees the whole batch.
+// Adapted from Michael and Scott, Simple, Fast, and Practical Non-Blocking
+// and Blocking Concurrent Queue Algorithms
+template<class TValue>
+class LinkedQueue {
+    private:
+        struct Node {
+            std::atomic<Node *> next;
+            // Links unlinked nodes while they wait to be freed.
+            Node * retired;
+            alignas(TValue) unsigned char storage[sizeof(TValue)];
+
+            Node() : next(NULL), retired(NULL) {};
+
+            TValue * value() {
+                return reinterpret_cast<TValue *>(this->storage);
+            };
+        };
+
+        alignas(64) std::atomic<Node *> head;
+        alignas(64) std::atomic<Node *> tail;
+        Epoch epoch;
+        RetireList<Node> retired;
+
+    public:
+        LinkedQueue() : retired(this->epoch) {
+            Node * dummy = new Node();
+            this->head.store(dummy);
+            this->tail.store(dummy);
+        };
+
+        LinkedQueue(const LinkedQueue &) = delete;
+        LinkedQueue & operator=(const LinkedQueue &) = delete;
+
+        // No other thread may use the queue any more.
+        ~LinkedQueue() {
+            Node * x = this->head.load();
+            // The first node is the dummy, which holds no value.
+            Node * next = x->next.load();
+            delete x;
+            for (x = next; x; x = next) {
+                next = x->next.load();
+                x->value()->~TValue();
+                delete x;
+            }
+        };
+
+        // Adds a value at the tail.
+        // Constant time, O(1), unless other threads keep winning the race.
+        void push(TValue value) {
+            Node * x = new Node();
+            new (x->storage) TValue(std::move(value));
+            Epoch::Guard guard(this->epoch);
+            for (;;) {
+                Node * last = this->tail.load(std::memory_order_acquire);
+                Node * next = last->next.load(std::memory_order_acquire);
+                if (last != this->tail.load(std::memory_order_acquire))
+                    continue;
+                if (next) {
+                    // The tail is behind, help move it on.
+                    this->tail.compare_exchange_weak(last, next, std::memory_order_release,
+                                                     std::memory_order_relaxed);
+                    continue;
+                }
+                if (last->next.compare_exchange_weak(next, x, std::memory_order_release,
+                                                     std::memory_order_relaxed)) {
+                    this->tail.compare_exchange_strong(last, x, std::memory_order_release,
+                                                       std::memory_order_relaxed);
+                    return;
+                }
+            }
+        };
+
+        // Removes the value at the head and puts it in value. Returns false
+        // if the queue is empty.
+        // Constant time, O(1), unless other threads keep winning the race.
+        bool try_pop(TValue & value) {
+            Node * first;
+            {
+                Epoch::Guard guard(this->epoch);
+                for (;;) {
+                    first = this->head.load(std::memory_order_acquire);
+                    Node * last = this->tail.load(std::memory_order_acquire);
+                    Node * next = first->next.load(std::memory_order_acquire);
+                    if (first != this->head.load(std::memory_order_acquire))
+                        continue;
+                    if (!next)
+                        return false;
+                    if (first == last) {
+                        this->tail.compare_exchange_weak(last, next, std::memory_order_release,
+                                                         std::memory_order_relaxed);
+                        continue;
+                    }
+                    if (this->head.compare_exchange_weak(first, next, std::memory_order_acq_rel,
+                                                         std::memory_order_relaxed)) {
+                        // next is the new dummy. Only this thread takes its
+                        // value.
+                        value = std::move(*next->value());
+                        next->value()->~TValue();
+                        break;
+                    }
+                }
+            }
+            this->retired.retire(first);
+            return true;
+        };
+
+        // Returns true if the queue was empty when it was looked at.
+        bool empty() {
+            Epoch::Guard guard(this->epoch);
+            return this->head.load()->next.load() == NULL;
+        };
+};
+
+#endif
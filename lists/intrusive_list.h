@@ -0,0 +1,330 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _INTRUSIVE_LIST_H_
+#define _INTRUSIVE_LIST_H_
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <string>
+#include <sstream>
+#include "../util.h"
+
+// The links of an IntrusiveList, to be put in the objects of the list.
+// An object can be in as many lists at a time as it has hooks.
+struct IntrusiveListHook {
+    IntrusiveListHook * prev = NULL;
+    IntrusiveListHook * next = NULL;
+
+    IntrusiveListHook() {};
+
+    // A copy of an object is not in any list.
+    IntrusiveListHook(const IntrusiveListHook &) {};
+
+    IntrusiveListHook & operator=(const IntrusiveListHook &) {
+        return *this;
+    };
+
+    // Returns true if the object is in a list.
+    bool linked() const {
+        return this->next != NULL;
+    };
+};
+
+// A double-link list of objects that carry their own links.
+//
+// The list never allocates and never copies or deletes the objects. Every
+// object has an IntrusiveListHook member that the list links through, so
+// inserting and removing an object are a few pointer writes, and an object
+// can be removed in constant time with nothing but a reference to it. The
+// list is a ring through a hook of its own, so there are no special cases
+// for the ends.
+//
+// An object must be removed from the list before it is destroyed.
+//
+// The list is given the offset of the hook in the object, which is a
+// constant, so going from a hook back to its object is a subtraction. The
+// offset comes from offsetof, which needs a standard-layout type.
+//
+//     struct Task {
+//         int id;
+//         IntrusiveListHook hook;
+//     };
+//     IntrusiveList<Task, offsetof(Task, hook)> queue;
+template<class T, std::size_t Offset>
+class IntrusiveList {
+    static_assert(std::is_standard_layout<T>::value,
+                  "IntrusiveList needs a standard-layout type for offsetof");
+    static_assert(Offset + sizeof(IntrusiveListHook) <= sizeof(T),
+                  "IntrusiveList needs the offset of a hook in the type");
+
+    private:
+        IntrusiveListHook root;
+        long length = 0;
+
+        static IntrusiveListHook * hook(T & x) {
+            return reinterpret_cast<IntrusiveListHook *>(reinterpret_cast<char *>(&x) + Offset);
+        };
+
+        // Returns the object that holds the hook h.
+        static T * owner(IntrusiveListHook * h) {
+            return reinterpret_cast<T *>(reinterpret_cast<char *>(h) - Offset);
+        };
+
+        // Links h in before pos.
+        static void link(IntrusiveListHook * h, IntrusiveListHook * pos) {
+            h->next = pos;
+            h->prev = pos->prev;
+            pos->prev->next = h;
+            pos->prev = h;
+        };
+
+        static void unlink(IntrusiveListHook * h) {
+            h->prev->next = h->next;
+            h->next->prev = h->prev;
+            h->prev = NULL;
+            h->next = NULL;
+        };
+
+    public:
+        class iterator {
+            private:
+                IntrusiveListHook * h;
+
+                friend class IntrusiveList;
+
+            public:
+                typedef std::bidirectional_iterator_tag iterator_category;
+                typedef T value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef T * pointer;
+                typedef T & reference;
+
+                iterator(IntrusiveListHook * h = NULL) : h(h) {};
+
+                reference operator*() const {
+                    return *owner(this->h);
+                };
+
+                pointer operator->() const {
+                    return owner(this->h);
+                };
+
+                iterator & operator++() {
+                    this->h = this->h->next;
+                    return *this;
+                };
+
+                iterator operator++(int) {
+                    iterator it = *this;
+                    this->h = this->h->next;
+                    return it;
+                };
+
+                iterator & operator--() {
+                    this->h = this->h->prev;
+                    return *this;
+                };
+
+                iterator operator--(int) {
+                    iterator it = *this;
+                    this->h = this->h->prev;
+                    return it;
+                };
+
+                bool operator==(const iterator & other) const {
+                    return this->h == other.h;
+                };
+
+                bool operator!=(const iterator & other) const {
+                    return this->h != other.h;
+                };
+        };
+
+        IntrusiveList() {
+            this->root.prev = &this->root;
+            this->root.next = &this->root;
+        };
+
+        // The objects point at the root, which cannot move.
+        IntrusiveList(const IntrusiveList &) = delete;
+        IntrusiveList & operator=(const IntrusiveList &) = delete;
+
+        // Leaves the objects that are still in the list unlinked.
+        ~IntrusiveList() {
+            clear();
+        };
+
+        // Returns an iterator to the given object, which must be in the
+        // list.
+        // Constant time, O(1).
+        iterator iterator_to(T & x) {
+            return iterator(hook(x));
+        };
+
+        // Adds x to the end of the list. x must not be in a list already
+        // through the same hook.
+        // Constant time, O(1).
+        void push_back(T & x) {
+            link(hook(x), &this->root);
+            this->length++;
+        };
+
+        // Adds x to the front of the list.
+        // Constant time, O(1).
+        void push_front(T & x) {
+            link(hook(x), this->root.next);
+            this->length++;
+        };
+
+        // Adds x before pos.
+        // Constant time, O(1).
+        iterator insert_before(iterator pos, T & x) {
+            link(hook(x), pos.h);
+            this->length++;
+            return iterator(hook(x));
+        };
+
+        // Adds x after pos.
+        // Constant time, O(1).
+        iterator insert_after(iterator pos, T & x) {
+            link(hook(x), pos.h->next);
+            this->length++;
+            return iterator(hook(x));
+        };
+
+        // Takes x out of the list.
+        // Constant time, O(1).
+        void erase(T & x) {
+            unlink(hook(x));
+            this->length--;
+        };
+
+        // Takes the object at pos out of the list and returns an iterator to
+        // the one after it.
+        // Constant time, O(1).
+        iterator erase(iterator pos) {
+            IntrusiveListHook * next = pos.h->next;
+            unlink(pos.h);
+            this->length--;
+            return iterator(next);
+        };
+
+        T & front() {
+            return *owner(this->root.next);
+        };
+
+        T & back() {
+            return *owner(this->root.prev);
+        };
+
+        // Takes the first object out of the list and returns it. The list
+        // must not be empty.
+        // Constant time, O(1).
+        T & pop_front() {
+            T & x = front();
+            erase(x);
+            return x;
+        };
+
+        T & pop_back() {
+            T & x = back();
+            erase(x);
+            return x;
+        };
+
+        // Moves x, which must be in the list, to the front.
+        // Constant time, O(1).
+        void move_to_front(T & x) {
+            unlink(hook(x));
+            link(hook(x), this->root.next);
+        };
+
+        // Moves x, which must be in the list, to the back.
+        // Constant time, O(1).
+        void move_to_back(T & x) {
+            unlink(hook(x));
+            link(hook(x), &this->root);
+        };
+
+        // Moves x from other to before pos in this list.
+        // Constant time, O(1).
+        void splice(iterator pos, IntrusiveList & other, T & x) {
+            if (pos.h == hook(x))
+                return;
+            other.erase(x);
+            link(hook(x), pos.h);
+            this->length++;
+        };
+
+        // Moves all objects of other to before pos in this list.
+        // Constant time, O(1).
+        void splice(iterator pos, IntrusiveList & other) {
+            if (&other == this || other.empty())
+                return;
+            IntrusiveListHook * first = other.root.next;
+            IntrusiveListHook * last = other.root.prev;
+            first->prev = pos.h->prev;
+            pos.h->prev->next = first;
+            last->next = pos.h;
+            pos.h->prev = last;
+            this->length += other.length;
+            other.root.prev = &other.root;
+            other.root.next = &other.root;
+            other.length = 0;
+        };
+
+        iterator begin() {
+            return iterator(this->root.next);
+        };
+
+        iterator end() {
+            return iterator(&this->root);
+        };
+
+        long size() {
+            return this->length;
+        };
+
+        bool empty() {
+            return this->length == 0;
+        };
+
+        // Takes all objects out of the list.
+        // Linear time O(n).
+        void clear() {
+            while (!empty())
+                pop_front();
+        };
+
+        // Returns a string representing all objects in the list, using
+        // to_string on each of them.
+        std::string printList() {
+            std::ostringstream os;
+            for (iterator it = begin(); it != end(); ++it)
+                os << to_string(*it) << std::endl;
+            return os.str();
+        };
+};
+
+#endif
@@ -25,87 +25,289 @@
 
 #include <string>
 #include <sstream>
+#include <iterator>
+#include <utility>
 #include "../util.h"
 
 // A double-link linked-list implementation.
+//
+// insert() returns an iterator to the new node. It stays valid until that
+// node is removed, and can be used as a handle to remove the value, to
+// insert next to it or to move it to another list, all in constant time.
+//
+// The list is a ring through a root link of its own, which is what end()
+// points at, so there are no special cases for the ends and an iterator
+// needs nothing but its node. Only end() belongs to the list object; it
+// changes when the nodes move to another list by a swap or a move.
 template<class TValue>
 class LinkedList {
     protected:
-        struct LLNode {
+        // The links of a node, and of the root.
+        struct Link {
+            Link * prev;
+            Link * next;
+        };
+
+        struct LLNode : Link {
             TValue value;
-            LLNode * prev;
-            LLNode * next;
 
             LLNode(TValue value) {
-                prev = NULL;
-                next = NULL;
+                this->prev = NULL;
+                this->next = NULL;
                 this->value = value;
             };
         };
 
-        LLNode * head = NULL;
-        LLNode * tail = NULL;
+        Link root;
+        long length = 0;
+
+        static LLNode * node_of(Link * x) {
+            return static_cast<LLNode *>(x);
+        };
 
         // Linear search that returns the first node that matches the given
-        // value.
-        LLNode * search(TValue value) {
-            if (this->head) {
-                LLNode * curNode = this->head;
-                do {
-                    if (curNode->value == value)
-                        return curNode;
-                    curNode = curNode->next;
-                }
-                while (curNode != this->head);
+        // value, or the root.
+        Link * search(TValue value) {
+            for (Link * x = this->root.next; x != &this->root; x = x->next) {
+                if (node_of(x)->value == value)
+                    return x;
             }
-            return NULL;
+            return &this->root;
+        };
+
+        // Links the node in before pos.
+        void link(Link * node, Link * pos) {
+            node->next = pos;
+            node->prev = pos->prev;
+            pos->prev->next = node;
+            pos->prev = node;
+            this->length++;
+        };
+
+        // Takes the node out of the list without deleting it.
+        void unlink(Link * node) {
+            node->prev->next = node->next;
+            node->next->prev = node->prev;
+            node->prev = NULL;
+            node->next = NULL;
+            this->length--;
+        };
+
+        // Makes the list empty without touching the nodes.
+        void reset() {
+            this->root.prev = &this->root;
+            this->root.next = &this->root;
+            this->length = 0;
         };
 
     public:
-        // Inserts the given value to the end of the list.
+        class iterator {
+            private:
+                Link * node;
+
+                friend class LinkedList;
+
+            public:
+                typedef std::bidirectional_iterator_tag iterator_category;
+                typedef TValue value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef TValue * pointer;
+                typedef TValue & reference;
+
+                iterator(Link * node = NULL) : node(node) {};
+
+                reference operator*() const {
+                    return node_of(this->node)->value;
+                };
+
+                pointer operator->() const {
+                    return &node_of(this->node)->value;
+                };
+
+                iterator & operator++() {
+                    this->node = this->node->next;
+                    return *this;
+                };
+
+                iterator operator++(int) {
+                    iterator it = *this;
+                    ++*this;
+                    return it;
+                };
+
+                iterator & operator--() {
+                    this->node = this->node->prev;
+                    return *this;
+                };
+
+                iterator operator--(int) {
+                    iterator it = *this;
+                    --*this;
+                    return it;
+                };
+
+                bool operator==(const iterator & other) const {
+                    return this->node == other.node;
+                };
+
+                bool operator!=(const iterator & other) const {
+                    return this->node != other.node;
+                };
+        };
+
+        LinkedList() {
+            reset();
+        };
+
+        LinkedList(const LinkedList & other) : LinkedList() {
+            for (const Link * x = other.root.next; x != &other.root; x = x->next)
+                insert(static_cast<const LLNode *>(x)->value);
+        };
+
+        LinkedList(LinkedList && other) : LinkedList() {
+            swap(other);
+        };
+
+        LinkedList & operator=(LinkedList other) {
+            swap(other);
+            return *this;
+        };
+
+        ~LinkedList() {
+            clear();
+        };
+
+        // Swaps the nodes of the two lists. Iterators to the nodes stay
+        // valid and follow them.
+        // Constant time, O(1).
+        void swap(LinkedList & other) {
+            LinkedList mine;
+            mine.splice(mine.end(), *this);
+            this->splice(this->end(), other);
+            other.splice(other.end(), mine);
+        };
+
+        // Inserts the given value to the end of the list and returns an
+        // iterator to it.
         // Constant time insertion, O(1). 
-        void insert(TValue value) {
+        iterator insert(TValue value) {
             LLNode * node = new LLNode(value);
+            link(node, &this->root);
+            return iterator(node);
+        };
 
-            // If there is no head, set the node to be both head and tail and
-            // next node. Otherwise append to the end of the list.
-        	if (!this->head) {
-        		this->head = node;
-        		this->tail = node;
-        		node->next = node;
-        		node->prev = node;
-        	}
-        	else {
-                node->prev = this->tail;
-        		node->next = this->head;
-        		this->tail->next = node;
-                this->head->prev = node;
-        		this->tail = node;
-        	}
+        // Inserts the given value before pos and returns an iterator to it.
+        // Constant time, O(1).
+        iterator insert_before(iterator pos, TValue value) {
+            LLNode * node = new LLNode(value);
+            link(node, pos.node);
+            return iterator(node);
+        };
+
+        // Inserts the given value after pos and returns an iterator to it.
+        // Constant time, O(1).
+        iterator insert_after(iterator pos, TValue value) {
+            LLNode * node = new LLNode(value);
+            link(node, pos.node->next);
+            return iterator(node);
+        };
+
+        // Removes the value at pos and returns an iterator to the value
+        // after it.
+        // Constant time, O(1).
+        iterator erase(iterator pos) {
+            Link * next = pos.node->next;
+            unlink(pos.node);
+            delete node_of(pos.node);
+            return iterator(next);
         };
 
         // Removes the first node that matches the given value.
         // Linear time O(n).
         void remove(TValue value) {
-            LLNode * node = this->search(value);
-            if (node) {
-                node->prev->next = node->next;
-                delete node;
+            Link * node = this->search(value);
+            if (node != &this->root)
+                erase(iterator(node));
+        };
+
+        // Returns an iterator to the first value that matches the given
+        // value, or end().
+        // Linear time O(n).
+        iterator find(TValue value) {
+            return iterator(this->search(value));
+        };
+
+        bool contains(TValue value) {
+            return this->search(value) != &this->root;
+        };
+
+        // Moves the node at it from other to before pos in this list.
+        // Iterators to the node stay valid. other can be this list.
+        // Constant time, O(1).
+        void splice(iterator pos, LinkedList & other, iterator it) {
+            if (it == pos)
+                return;
+            other.unlink(it.node);
+            link(it.node, pos.node);
+        };
+
+        // Moves all nodes of other to before pos in this list. Iterators to
+        // the nodes stay valid.
+        // Constant time, O(1).
+        void splice(iterator pos, LinkedList & other) {
+            if (&other == this || other.empty())
+                return;
+            Link * first = other.root.next;
+            Link * last = other.root.prev;
+            first->prev = pos.node->prev;
+            pos.node->prev->next = first;
+            last->next = pos.node;
+            pos.node->prev = last;
+            this->length += other.length;
+            other.reset();
+        };
+
+        iterator begin() {
+            return iterator(this->root.next);
+        };
+
+        iterator end() {
+            return iterator(&this->root);
+        };
+
+        TValue & front() {
+            return node_of(this->root.next)->value;
+        };
+
+        TValue & back() {
+            return node_of(this->root.prev)->value;
+        };
+
+        long size() {
+            return this->length;
+        };
+
+        bool empty() {
+            return this->length == 0;
+        };
+
+        // Removes all values.
+        // Linear time O(n).
+        void clear() {
+            Link * x = this->root.next;
+            while (x != &this->root) {
+                Link * next = x->next;
+                delete node_of(x);
+                x = next;
             }
+            reset();
         };
 
         // Returns a string representing all nodes in this linked list.
         std::string printList() {
             std::ostringstream os;
-            // Make sure there is at least one node before starting.
-            if (this->head) {
-                LLNode * curNode = this->head;
-                do {
-                    os << to_string(curNode->value) << std::endl;
-                    curNode = curNode->next;
-                }
-                while (curNode != this->head);
-            }
+            for (Link * x = this->root.next; x != &this->root; x = x->next)
+                os << to_string(node_of(x)->value) << std::endl;
             return os.str();
         };
 };
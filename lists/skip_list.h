@@ -0,0 +1,733 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _SKIP_LIST_H_
+#define _SKIP_LIST_H_
+
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <sstream>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "../pool.h"
+#include "../epoch.h"
+
+// The highest tower in a skip list.
+const int SKIP_LIST_LEVELS = 32;
+
+// Returns a random tower height, where every level is a quarter as likely as
+// the one below it.
+inline int skip_list_level(unsigned long & seed) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    int level = 1 + __builtin_ctzl(seed | (1UL << 62)) / 2;
+    return level < SKIP_LIST_LEVELS ? level : SKIP_LIST_LEVELS;
+}
+
+// An ordered map kept in a list with express lanes.
+//
+// Every node has a tower of links with a random height, and level i of the
+// list links all nodes whose tower is higher than i. A search starts at the
+// top level and drops a level whenever the next key is too large, so it
+// skips over most of the list and takes O(log n) steps on average. Nothing
+// is ever rebalanced.
+//
+// The tower is stored at the end of the node, so a node is one block of
+// memory that is only as big as its height needs. Nodes come from a pool per
+// size class, with towers of height 1, 2, 4, and so on.
+//
+// The map has the same operations as Tree, and, like Tree, keeps every key
+// that is inserted, even if it is there already.
+// Adapted from Pugh, Skip Lists: A Probabilistic Alternative to Balanced
+// Trees
+template<class TKey, class TValue>
+class SkipList {
+    public:
+        // A node of the list. The tower is next[0] up to next[level - 1],
+        // and is allocated together with the node.
+        struct Node {
+            TKey key;
+            TValue value;
+            int level;
+            Node * next[1];
+
+            Node(int level) : key(), value(), level(level) {};
+            Node(TKey key, TValue value, int level) :
+                key(key), value(value), level(level) {};
+        };
+
+    private:
+        // Pools for the nodes with a tower of at most Height levels, and,
+        // through rest, for the higher ones.
+        template<int Height, bool Last = (Height >= SKIP_LIST_LEVELS)>
+        struct TowerPool {
+            struct alignas(Node) Storage {
+                unsigned char bytes[sizeof(Node) + (Height - 1) * sizeof(Node *)];
+            };
+
+            NodePool<Storage> pool;
+            TowerPool<Height * 2> rest;
+
+            void * create(int level) {
+                return level <= Height ? (void *)this->pool.create() : this->rest.create(level);
+            };
+
+            void destroy(void * x, int level) {
+                if (level <= Height)
+                    this->pool.destroy(static_cast<Storage *>(x));
+                else
+                    this->rest.destroy(x, level);
+            };
+
+            void clear() {
+                this->pool.clear();
+                this->rest.clear();
+            };
+        };
+
+        template<int Height>
+        struct TowerPool<Height, true> {
+            struct alignas(Node) Storage {
+                unsigned char bytes[sizeof(Node) + (Height - 1) * sizeof(Node *)];
+            };
+
+            NodePool<Storage> pool;
+
+            void * create(int) {
+                return this->pool.create();
+            };
+
+            void destroy(void * x, int) {
+                this->pool.destroy(static_cast<Storage *>(x));
+            };
+
+            void clear() {
+                this->pool.clear();
+            };
+        };
+
+        TowerPool<1> pool;
+        // The head has a full tower and no key.
+        Node * head;
+        // The highest level that has any nodes, at least 1.
+        int levels = 1;
+        long length = 0;
+        unsigned long seed = 88172645463325252UL;
+
+        template<class... Args>
+        Node * create_node(int level, Args &&... args) {
+            Node * x = new (this->pool.create(level)) Node(std::forward<Args>(args)..., level);
+            for (int i = 0; i < level; i++)
+                x->next[i] = NULL;
+            return x;
+        };
+
+        void destroy_node(Node * x) {
+            int level = x->level;
+            x->~Node();
+            this->pool.destroy(x, level);
+        };
+
+        // Puts the last node before k on every level in update. A node is
+        // before k if its key is less than k, or, if after is true, not
+        // greater than k.
+        // Logarithmic time on average, O(log n).
+        void seek(const TKey & k, bool after, Node ** update) {
+            Node * x = this->head;
+            for (int i = this->levels - 1; i >= 0; i--) {
+                Node * y;
+                while ((y = x->next[i]) && (after ? !(k < y->key) : y->key < k))
+                    x = y;
+                update[i] = x;
+            }
+        };
+
+    public:
+        // A forward iterator over the nodes in order. Dereferencing it gives
+        // the node, so the key and value are available as it->key and
+        // it->value. The key must not be changed.
+        class iterator {
+            private:
+                Node * node;
+
+                friend class SkipList;
+
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef Node value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef Node * pointer;
+                typedef Node & reference;
+
+                iterator(Node * node = NULL) : node(node) {};
+
+                Node & operator*() const {
+                    return *this->node;
+                };
+
+                Node * operator->() const {
+                    return this->node;
+                };
+
+                // Constant time, O(1).
+                iterator & operator++() {
+                    this->node = this->node->next[0];
+                    return *this;
+                };
+
+                iterator operator++(int) {
+                    iterator it = *this;
+                    this->node = this->node->next[0];
+                    return it;
+                };
+
+                bool operator==(const iterator & other) const {
+                    return this->node == other.node;
+                };
+
+                bool operator!=(const iterator & other) const {
+                    return this->node != other.node;
+                };
+        };
+
+        SkipList() {
+            this->head = create_node(SKIP_LIST_LEVELS);
+        };
+
+        SkipList(const SkipList &) = delete;
+        SkipList & operator=(const SkipList &) = delete;
+
+        ~SkipList() {
+            clear();
+            destroy_node(this->head);
+        };
+
+        // Puts a new node into the list, after any nodes with the same key.
+        // Logarithmic time on average, O(log n).
+        void insert(TKey key, TValue value) {
+            Node * update[SKIP_LIST_LEVELS];
+            int level = skip_list_level(this->seed);
+            for (int i = this->levels; i < level; i++)
+                update[i] = this->head;
+            seek(key, true, update);
+            if (level > this->levels)
+                this->levels = level;
+            Node * x = create_node(level, key, value);
+            for (int i = 0; i < level; i++) {
+                x->next[i] = update[i]->next[i];
+                update[i]->next[i] = x;
+            }
+            this->length++;
+        };
+
+        // Removes the first node with the key k. Returns false if there is
+        // none.
+        // Logarithmic time on average, O(log n).
+        bool erase(TKey k) {
+            Node * update[SKIP_LIST_LEVELS];
+            seek(k, false, update);
+            Node * x = update[0]->next[0];
+            if (!x || k < x->key)
+                return false;
+            // x is the first node with the key on every level it is on.
+            for (int i = 0; i < x->level; i++)
+                update[i]->next[i] = x->next[i];
+            while (this->levels > 1 && !this->head->next[this->levels - 1])
+                this->levels--;
+            destroy_node(x);
+            this->length--;
+            return true;
+        };
+
+        // Removes all nodes. The memory is given back size class by size
+        // class, and the nodes are only visited if the keys or values need
+        // a destructor.
+        void clear() {
+            if (!std::is_trivially_destructible<Node>::value) {
+                for (Node * x = this->head->next[0]; x; ) {
+                    Node * next = x->next[0];
+                    x->~Node();
+                    x = next;
+                }
+            }
+            // The head lives in one of the pools too, so it is made again.
+            this->head->~Node();
+            this->pool.clear();
+            this->head = create_node(SKIP_LIST_LEVELS);
+            this->levels = 1;
+            this->length = 0;
+        };
+
+        // Returns an iterator to the node with the smallest key.
+        iterator begin() {
+            return iterator(this->head->next[0]);
+        };
+
+        iterator end() {
+            return iterator();
+        };
+
+        // Returns an iterator to the first node whose key is not less than
+        // k.
+        // Logarithmic time on average, O(log n).
+        iterator lower_bound(TKey k) {
+            Node * update[SKIP_LIST_LEVELS];
+            seek(k, false, update);
+            return iterator(update[0]->next[0]);
+        };
+
+        // Returns an iterator to the first node whose key is greater than k.
+        // Logarithmic time on average, O(log n).
+        iterator upper_bound(TKey k) {
+            Node * update[SKIP_LIST_LEVELS];
+            seek(k, true, update);
+            return iterator(update[0]->next[0]);
+        };
+
+        // Returns an iterator to a node with the key k, or end() if there is
+        // no such node.
+        // Logarithmic time on average, O(log n).
+        iterator find(TKey k) {
+            iterator it = lower_bound(k);
+            if (it.node && !(k < it.node->key))
+                return it;
+            return end();
+        };
+
+        bool contains(TKey k) {
+            return find(k) != end();
+        };
+
+        // Calls visit(key, value) for every node with a key in [lo, hi], in
+        // order.
+        // Logarithmic time on average to find lo, and then constant time for
+        // every node that is visited.
+        template<class TVisitor>
+        void range_scan(TKey lo, TKey hi, TVisitor visit) {
+            for (Node * x = lower_bound(lo).node; x && !(hi < x->key); x = x->next[0])
+                visit(x->key, x->value);
+        };
+
+        // Searches for the key k and returns its value, or a default value if
+        // k is not in the list.
+        // Logarithmic time on average, O(log n).
+        TValue iterative_tree_search(TKey k) {
+            Node * x = this->head;
+            for (int i = this->levels - 1; i >= 0; i--) {
+                Node * y;
+                while ((y = x->next[i]) && y->key < k)
+                    x = y;
+            }
+            x = x->next[0];
+            return x && !(k < x->key) ? x->value : TValue();
+        };
+
+        // Returns the smallest key. The list must not be empty.
+        // Constant time, O(1).
+        TKey tree_minimum() {
+            return this->head->next[0]->key;
+        };
+
+        // Returns the largest key. The list must not be empty.
+        // Logarithmic time on average, O(log n).
+        TKey tree_maximum() {
+            Node * x = this->head;
+            for (int i = this->levels - 1; i >= 0; i--) {
+                while (x->next[i])
+                    x = x->next[i];
+            }
+            return x->key;
+        };
+
+        // Returns the highest level that has any nodes.
+        int height() {
+            return this->levels;
+        };
+
+        long size() {
+            return this->length;
+        };
+
+        bool empty() {
+            return this->length == 0;
+        };
+
+        // Prints all nodes in order, in the same format as Tree.
+        // Linear time, O(n).
+        std::string inorder_tree_walk() {
+            std::ostringstream os;
+            for (Node * x = this->head->next[0]; x; x = x->next[0])
+                os << x->key << ": " << x->value << std::endl;
+            return os.str();
+        };
+};
+
+// A skip list map that many threads can search and change at the same time
+// without locks.
+//
+// A node is put in by linking it into the bottom level with a
+// compare-and-swap, which is the moment it is in the map, and then into the
+// levels above it one at a time. A node is taken out by marking the links in
+// its tower, top down, in the lowest bit of the pointers. Marking the bottom
+// link is the moment it leaves the map, and whichever thread does that has
+// removed it. A marked link is never changed again. Searches unlink the
+// marked nodes they pass with a compare-and-swap on the node before them,
+// which fails if that node is being removed too.
+//
+// A removed node can be freed once it is unlinked on every level and no
+// thread is still looking at it. The thread that put the node in and the
+// thread that took it out each say when they are done with it. The second
+// one makes sure the node is unlinked everywhere and retires it, and the
+// RetireList frees removed nodes in batches once the Epoch has moved on.
+//
+// Unlike SkipList, a key is in the map at most once.
+// Adapted from Herlihy and Shavit, The Art of Multiprocessor Programming,
+// section 14.4, and Fraser, Practical Lock-Freedom
+template<class TKey, class TValue>
+class ConcurrentSkipList {
+    private:
+        typedef std::atomic<uintptr_t> Link;
+
+        struct Node {
+            TKey key;
+            TValue value;
+            int level;
+            // The number of threads, out of the one that put the node in and
+            // the one that took it out, that are done with it.
+            std::atomic<int> done;
+            // Links removed nodes while they wait to be freed.
+            Node * retired;
+            Link next[1];
+
+            Node(TKey key, TValue value, int level) :
+                key(key), value(value), level(level), done(0), retired(NULL) {};
+        };
+
+        static void destroy_node(Node * x) {
+            x->~Node();
+            ::operator delete(x);
+        };
+
+        struct NodeDelete {
+            void operator()(Node * x) const {
+                destroy_node(x);
+            };
+        };
+
+        Node * head;
+        // The highest level that may have any nodes.
+        std::atomic<int> levels;
+        std::atomic<long> length;
+        Epoch epoch;
+        RetireList<Node, NodeDelete> retired;
+
+        static Node * pointer(uintptr_t link) {
+            return reinterpret_cast<Node *>(link & ~(uintptr_t)1);
+        };
+
+        static bool marked(uintptr_t link) {
+            return link & 1;
+        };
+
+        // Returns a random height, from a generator of the calling thread.
+        static int random_level() {
+            thread_local unsigned long seed = 0x9E3779B97F4A7C15UL *
+                (1 + std::hash<std::thread::id>()(std::this_thread::get_id()));
+            return skip_list_level(seed);
+        };
+
+        static Node * create_node(int level, TKey key = TKey(), TValue value = TValue()) {
+            void * memory = ::operator new(sizeof(Node) + (level - 1) * sizeof(Link));
+            Node * x = new (memory) Node(key, value, level);
+            x->next[0].store(0, std::memory_order_relaxed);
+            for (int i = 1; i < level; i++)
+                new (&x->next[i]) Link(0);
+            return x;
+        };
+
+        // Puts the last node with a key less than k on every level in preds
+        // and the node after it in succs, unlinking any marked nodes in the
+        // way. If x is given, the search also goes past the nodes with the
+        // key k, so that x is unlinked wherever it is among them. Returns
+        // true if a node with the key k was found.
+        // Must be called inside a guard.
+        // Logarithmic time on average, O(log n), unless other threads keep
+        // changing the same nodes.
+        bool seek(const TKey & k, Node ** preds, Node ** succs, Node * x = NULL) {
+        retry:
+            Node * pred = this->head;
+            for (int i = this->levels.load(std::memory_order_acquire) - 1; i >= 0; i--) {
+                // last is the node before curr, which is pred unless we are
+                // going past the nodes with the key k.
+                Node * last = pred;
+                Node * curr = pointer(pred->next[i].load(std::memory_order_acquire));
+                while (curr) {
+                    uintptr_t link = curr->next[i].load(std::memory_order_acquire);
+                    if (marked(link)) {
+                        uintptr_t expected = reinterpret_cast<uintptr_t>(curr);
+                        if (!last->next[i].compare_exchange_strong(expected, link & ~(uintptr_t)1,
+                                std::memory_order_acq_rel, std::memory_order_acquire))
+                            goto retry;
+                        curr = pointer(link);
+                    }
+                    else if (curr->key < k) {
+                        pred = last = curr;
+                        curr = pointer(link);
+                    }
+                    else if (x && !(k < curr->key)) {
+                        last = curr;
+                        curr = pointer(link);
+                    }
+                    else
+                        break;
+                }
+                preds[i] = pred;
+                succs[i] = x ? NULL : curr;
+            }
+            return succs[0] && !(k < succs[0]->key);
+        };
+
+        // Called once by the thread that put x in, when it stops linking it,
+        // and once by the thread that took it out. The second call unlinks x
+        // on every level and retires it.
+        // Must not be called inside a guard.
+        void release(Node * x) {
+            if (x->done.fetch_add(1, std::memory_order_acq_rel) == 0)
+                return;
+            {
+                Epoch::Guard guard(this->epoch);
+                Node * preds[SKIP_LIST_LEVELS];
+                Node * succs[SKIP_LIST_LEVELS];
+                seek(x->key, preds, succs, x);
+            }
+            this->retired.retire(x);
+        };
+
+        // Frees every node in the list.
+        void free_all() {
+            Node * x = pointer(this->head->next[0].load());
+            while (x) {
+                Node * next = pointer(x->next[0].load());
+                destroy_node(x);
+                x = next;
+            }
+        };
+
+    public:
+        ConcurrentSkipList() : levels(1), length(0), retired(this->epoch) {
+            this->head = create_node(SKIP_LIST_LEVELS);
+        };
+
+        ConcurrentSkipList(const ConcurrentSkipList &) = delete;
+        ConcurrentSkipList & operator=(const ConcurrentSkipList &) = delete;
+
+        // No other thread may use the list any more.
+        ~ConcurrentSkipList() {
+            free_all();
+            destroy_node(this->head);
+        };
+
+        // Puts the key k with the given value in the map. Returns false, and
+        // changes nothing, if k is there already.
+        // Logarithmic time on average, O(log n), unless other threads keep
+        // changing the same nodes.
+        bool insert(TKey key, TValue value) {
+            int level = random_level();
+            int top = this->levels.load(std::memory_order_relaxed);
+            while (top < level && !this->levels.compare_exchange_weak(top, level))
+                ;
+            Node * preds[SKIP_LIST_LEVELS];
+            Node * succs[SKIP_LIST_LEVELS];
+            Node * x = NULL;
+            {
+                Epoch::Guard guard(this->epoch);
+                for (;;) {
+                    if (seek(key, preds, succs)) {
+                        if (x)
+                            destroy_node(x);
+                        return false;
+                    }
+                    if (!x)
+                        x = create_node(level, key, value);
+                    for (int i = 0; i < level; i++)
+                        x->next[i].store(reinterpret_cast<uintptr_t>(succs[i]),
+                                         std::memory_order_relaxed);
+                    uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+                    if (preds[0]->next[0].compare_exchange_strong(expected,
+                            reinterpret_cast<uintptr_t>(x),
+                            std::memory_order_release, std::memory_order_relaxed))
+                        break;
+                }
+                this->length.fetch_add(1, std::memory_order_relaxed);
+
+                // Link the rest of the tower. If x is taken out in the
+                // meantime, its links get marked and this stops.
+                for (int i = 1; i < level; i++) {
+                    bool linked = false;
+                    while (!linked) {
+                        uintptr_t link = x->next[i].load(std::memory_order_acquire);
+                        if (marked(link))
+                            break;
+                        uintptr_t succ = reinterpret_cast<uintptr_t>(succs[i]);
+                        if (link != succ && !x->next[i].compare_exchange_strong(link, succ,
+                                std::memory_order_release, std::memory_order_relaxed))
+                            continue;
+                        uintptr_t expected = succ;
+                        linked = preds[i]->next[i].compare_exchange_strong(expected,
+                            reinterpret_cast<uintptr_t>(x),
+                            std::memory_order_release, std::memory_order_relaxed);
+                        if (!linked && (!seek(key, preds, succs) || succs[0] != x))
+                            break;
+                    }
+                    if (!linked)
+                        break;
+                }
+            }
+            release(x);
+            return true;
+        };
+
+        // Takes the key k out of the map. Returns false if it is not there.
+        // Logarithmic time on average, O(log n), unless other threads keep
+        // changing the same nodes.
+        bool erase(TKey k) {
+            Node * x;
+            {
+                Epoch::Guard guard(this->epoch);
+                Node * preds[SKIP_LIST_LEVELS];
+                Node * succs[SKIP_LIST_LEVELS];
+                if (!seek(k, preds, succs))
+                    return false;
+                x = succs[0];
+                for (int i = x->level - 1; i >= 1; i--) {
+                    uintptr_t link = x->next[i].load(std::memory_order_relaxed);
+                    while (!marked(link) && !x->next[i].compare_exchange_weak(link, link | 1,
+                               std::memory_order_acq_rel, std::memory_order_relaxed))
+                        ;
+                }
+                uintptr_t link = x->next[0].load(std::memory_order_relaxed);
+                for (;;) {
+                    // Another thread took it out first.
+                    if (marked(link))
+                        return false;
+                    if (x->next[0].compare_exchange_weak(link, link | 1,
+                            std::memory_order_acq_rel, std::memory_order_relaxed))
+                        break;
+                }
+                this->length.fetch_sub(1, std::memory_order_relaxed);
+                // Unlink it right away, so searches do not have to.
+                seek(k, preds, succs, x);
+            }
+            release(x);
+            return true;
+        };
+
+        // Removes all nodes. No other thread may use the list meanwhile.
+        void clear() {
+            free_all();
+            this->retired.clear();
+            for (int i = 0; i < SKIP_LIST_LEVELS; i++)
+                this->head->next[i].store(0);
+            this->levels.store(1);
+            this->length.store(0);
+        };
+
+        // Searches for the key k without taking any locks or changing
+        // anything. If it is found, its value is copied to value and true is
+        // returned.
+        // Logarithmic time on average, O(log n).
+        bool find(TKey k, TValue & value) {
+            Epoch::Guard guard(this->epoch);
+            Node * x = this->head;
+            Node * y = NULL;
+            for (int i = this->levels.load(std::memory_order_acquire) - 1; i >= 0; i--) {
+                y = pointer(x->next[i].load(std::memory_order_acquire));
+                // Marked nodes are skipped over but left for others to
+                // unlink.
+                while (y) {
+                    uintptr_t link = y->next[i].load(std::memory_order_acquire);
+                    if (!marked(link) && !(y->key < k))
+                        break;
+                    if (!marked(link))
+                        x = y;
+                    y = pointer(link);
+                }
+            }
+            if (!y || k < y->key)
+                return false;
+            value = y->value;
+            return true;
+        };
+
+        // Returns true if the key k is in the map. Takes no locks.
+        bool contains(TKey k) {
+            TValue value;
+            return find(k, value);
+        };
+
+        // Searches for the key k without taking any locks.
+        // Returns the value, or a default value if k is not in the map.
+        TValue iterative_tree_search(TKey k) {
+            TValue value = TValue();
+            find(k, value);
+            return value;
+        };
+
+        // Returns the number of keys in the map. Only exact when no other
+        // thread is changing it.
+        long size() {
+            return this->length.load(std::memory_order_relaxed);
+        };
+
+        bool empty() {
+            return size() == 0;
+        };
+
+        // Calls visit(key, value) for every key in [lo, hi], in order,
+        // without taking any locks. Keys come out in increasing order and at
+        // most once. A key that is put in or taken out during the scan may
+        // or may not be visited.
+        template<class TVisitor>
+        void range_scan(TKey lo, TKey hi, TVisitor visit) {
+            Epoch::Guard guard(this->epoch);
+            Node * x = this->head;
+            for (int i = this->levels.load(std::memory_order_acquire) - 1; i >= 0; i--) {
+                Node * y;
+                while ((y = pointer(x->next[i].load(std::memory_order_acquire))) && y->key < lo)
+                    x = y;
+            }
+            for (x = pointer(x->next[0].load(std::memory_order_acquire)); x && !(hi < x->key); ) {
+                uintptr_t link = x->next[0].load(std::memory_order_acquire);
+                if (!marked(link) && !(x->key < lo))
+                    visit(x->key, x->value);
+                x = pointer(link);
+            }
+        };
+};
+
+#endif
@@ -0,0 +1,327 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _UNROLLED_LIST_H_
+#define _UNROLLED_LIST_H_
+
+#include <string>
+#include <sstream>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+#include "../util.h"
+#include "../pool.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Returns the index of the first of the n values that is equal to v, or -1.
+// This is the plain version that works for any value type.
+template<class TValue, int Size = sizeof(TValue),
+         bool Integral = std::is_integral<TValue>::value>
+struct ValueSearch {
+    static int find(const TValue * values, int n, const TValue & v) {
+        for (int i = 0; i < n; i++) {
+            if (values[i] == v)
+                return i;
+        }
+        return -1;
+    };
+};
+
+#if defined(__SSE2__)
+// SIMD version for 32-bit integral values.
+// Whole vectors are compared at a time and the rest of the values are
+// handled by the generic version.
+template<class TValue>
+struct ValueSearch<TValue, 4, true> {
+    static int find(const TValue * values, int n, const TValue & v) {
+        int i = 0;
+#if defined(__AVX2__)
+        const __m256i x = _mm256_set1_epi32((int)v);
+        for (; i + 8 <= n; i += 8) {
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+                _mm256_loadu_si256((const __m256i *)(values + i)), x)));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+#else
+        const __m128i x = _mm_set1_epi32((int)v);
+        for (; i + 4 <= n; i += 4) {
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+                _mm_loadu_si128((const __m128i *)(values + i)), x)));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+#endif
+        int j = ValueSearch<TValue, 0, false>::find(values + i, n - i, v);
+        return j < 0 ? -1 : i + j;
+    };
+};
+#endif
+
+#if defined(__SSE4_1__)
+// SIMD version for 64-bit integral values.
+// 64-bit compares need SSE4.1, so plain SSE2 builds use the generic version.
+template<class TValue>
+struct ValueSearch<TValue, 8, true> {
+    static int find(const TValue * values, int n, const TValue & v) {
+        int i = 0;
+#if defined(__AVX2__)
+        const __m256i x = _mm256_set1_epi64x((long long)v);
+        for (; i + 4 <= n; i += 4) {
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(
+                _mm256_loadu_si256((const __m256i *)(values + i)), x)));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+#else
+        const __m128i x = _mm_set1_epi64x((long long)v);
+        for (; i + 2 <= n; i += 2) {
+            int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(
+                _mm_loadu_si128((const __m128i *)(values + i)), x)));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+#endif
+        int j = ValueSearch<TValue, 0, false>::find(values + i, n - i, v);
+        return j < 0 ? -1 : i + j;
+    };
+};
+#endif
+
+// A list that keeps its values in order, with a block of values in every
+// node instead of a single one.
+//
+// A block is a few cache lines long and holds as many values as fit, so a
+// walk through the list reads memory mostly in order and follows a pointer
+// once per block instead of once per value. Blocks come from a pool. Values
+// are added at the end, and removing a value shifts the rest of its block
+// down, so the order is kept. A block that gets less than half full is
+// merged with the next one if they fit together.
+//
+// Searching compares a whole block at a time with SIMD instructions for
+// 32-bit and 64-bit integral values.
+// Adapted from Shao et. al., Unrolling Lists
+template<class TValue, int Bytes = 256>
+class UnrolledList {
+    private:
+        struct Block;
+
+        // The number of values in a block, so the block is about Bytes long.
+        static const int capacity =
+            (Bytes - 2 * (int)sizeof(Block *) - (int)sizeof(int)) / (int)sizeof(TValue) > 4 ?
+            (Bytes - 2 * (int)sizeof(Block *) - (int)sizeof(int)) / (int)sizeof(TValue) : 4;
+
+        // The values come first, so they start on a cache line.
+        struct alignas(64) Block {
+            TValue values[capacity];
+            Block * prev = NULL;
+            Block * next = NULL;
+            int count = 0;
+        };
+
+        NodePool<Block> pool;
+        Block * head = NULL;
+        Block * tail = NULL;
+        long length = 0;
+
+        // Takes the block b out of the list and gives it back to the pool.
+        void unlink(Block * b) {
+            if (b->prev)
+                b->prev->next = b->next;
+            else
+                this->head = b->next;
+            if (b->next)
+                b->next->prev = b->prev;
+            else
+                this->tail = b->prev;
+            this->pool.destroy(b);
+        };
+
+        // Removes the value at index i of block b.
+        void erase(Block * b, int i) {
+            for (int j = i + 1; j < b->count; j++)
+                b->values[j - 1] = std::move(b->values[j]);
+            b->count--;
+            this->length--;
+            if (b->count == 0) {
+                unlink(b);
+                return;
+            }
+            // Keep the blocks at least half full on average by merging a
+            // small block with the next one.
+            Block * next = b->next;
+            if (b->count < capacity / 2 && next && b->count + next->count <= capacity) {
+                for (int j = 0; j < next->count; j++)
+                    b->values[b->count + j] = std::move(next->values[j]);
+                b->count += next->count;
+                unlink(next);
+            }
+        };
+
+    public:
+        class iterator {
+            private:
+                Block * block;
+                int i;
+
+                friend class UnrolledList;
+
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef TValue value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const TValue * pointer;
+                typedef const TValue & reference;
+
+                iterator(Block * block = NULL, int i = 0) : block(block), i(i) {};
+
+                reference operator*() const {
+                    return this->block->values[this->i];
+                };
+
+                pointer operator->() const {
+                    return &this->block->values[this->i];
+                };
+
+                iterator & operator++() {
+                    if (++this->i == this->block->count) {
+                        this->block = this->block->next;
+                        this->i = 0;
+                    }
+                    return *this;
+                };
+
+                iterator operator++(int) {
+                    iterator it = *this;
+                    ++*this;
+                    return it;
+                };
+
+                bool operator==(const iterator & other) const {
+                    return this->block == other.block && this->i == other.i;
+                };
+
+                bool operator!=(const iterator & other) const {
+                    return !(*this == other);
+                };
+        };
+
+        UnrolledList() {};
+
+        UnrolledList(const UnrolledList &) = delete;
+        UnrolledList & operator=(const UnrolledList &) = delete;
+
+        ~UnrolledList() {
+            clear();
+        };
+
+        // Returns the number of values in a block.
+        static int block_capacity() {
+            return capacity;
+        };
+
+        // Inserts the given value to the end of the list.
+        // Constant time insertion, O(1).
+        void insert(TValue value) {
+            if (!this->tail || this->tail->count == capacity) {
+                Block * b = this->pool.create();
+                b->prev = this->tail;
+                if (this->tail)
+                    this->tail->next = b;
+                else
+                    this->head = b;
+                this->tail = b;
+            }
+            this->tail->values[this->tail->count++] = std::move(value);
+            this->length++;
+        };
+
+        // Returns an iterator to the first value that matches the given
+        // value, or end().
+        // Linear time O(n), but a block at a time.
+        iterator search(const TValue & value) {
+            for (Block * b = this->head; b; b = b->next) {
+                int i = ValueSearch<TValue>::find(b->values, b->count, value);
+                if (i >= 0)
+                    return iterator(b, i);
+            }
+            return end();
+        };
+
+        bool contains(const TValue & value) {
+            return search(value) != end();
+        };
+
+        // Removes the first value that matches the given value.
+        // Linear time O(n).
+        void remove(const TValue & value) {
+            iterator it = search(value);
+            if (it != end())
+                erase(it.block, it.i);
+        };
+
+        iterator begin() {
+            return iterator(this->head, 0);
+        };
+
+        iterator end() {
+            return iterator();
+        };
+
+        long size() {
+            return this->length;
+        };
+
+        bool empty() {
+            return this->length == 0;
+        };
+
+        // Removes all values and gives the blocks back.
+        void clear() {
+            if (!std::is_trivially_destructible<TValue>::value) {
+                while (this->head) {
+                    Block * next = this->head->next;
+                    this->pool.destroy(this->head);
+                    this->head = next;
+                }
+            }
+            this->pool.clear();
+            this->head = NULL;
+            this->tail = NULL;
+            this->length = 0;
+        };
+
+        // Returns a string representing all values in this list.
+        std::string printList() {
+            std::ostringstream os;
+            for (Block * b = this->head; b; b = b->next) {
+                for (int i = 0; i < b->count; i++)
+                    os << to_string(b->values[i]) << std::endl;
+            }
+            return os.str();
+        };
+};
+
+#endif
@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <new>
+#include <utility>
+#include <vector>
+
+// A pool that hands out nodes of type T from contiguous slabs of memory.
+// Destroyed nodes are put on a free list and handed out again by create(),
+// and all slabs are given back at once by clear().
+template<class T>
+class NodePool {
+    private:
+        // A free slot is linked to the next free slot through its own
+        // storage, so the free list costs no extra memory.
+        union Slot {
+            Slot * next;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        // The largest slab we allocate, in number of nodes.
+        static const long maxSlabSize = 1 << 16;
+
+        std::vector<Slot *> slabs;
+        Slot * freeList = NULL;
+        Slot * freeTail = NULL;
+        Slot * cursor = NULL;
+        Slot * end = NULL;
+        // Unused ends of slabs taken over from other pools by adopt().
+        std::vector<std::pair<Slot *, Slot *> > spares;
+        long slabSize;
+        long live = 0;
+
+        // Allocates a new slab with room for n nodes and makes it the one
+        // that create() carves nodes from.
+        void grow(long n) {
+            // Whatever is left of the current slab goes on the free list so
+            // it is not wasted.
+            while (cursor != end)
+                push_free(cursor++);
+            // Ask for the alignment of T explicitly, since nodes can be
+            // aligned to cache lines.
+            Slot * slab = static_cast<Slot *>(::operator new(n * sizeof(Slot),
+                std::align_val_t(alignof(Slot))));
+            slabs.push_back(slab);
+            cursor = slab;
+            end = slab + n;
+        };
+
+        void push_free(Slot * slot) {
+            slot->next = freeList;
+            if (!freeList)
+                freeTail = slot;
+            freeList = slot;
+        };
+
+        void release() {
+            for (size_t i = 0; i < slabs.size(); i++)
+                ::operator delete(slabs[i], std::align_val_t(alignof(Slot)));
+            slabs.clear();
+        };
+
+    public:
+        // Constructor.
+        // The first slab has room for slabSize nodes. Every following slab is
+        // twice as big as the one before it, up to maxSlabSize.
+        NodePool(long slabSize = 64) {
+            this->slabSize = slabSize;
+        };
+
+        NodePool(const NodePool &) = delete;
+        NodePool & operator=(const NodePool &) = delete;
+
+        NodePool(NodePool && other) : slabSize(64) {
+            swap(other);
+        };
+
+        NodePool & operator=(NodePool && other) {
+            swap(other);
+            return *this;
+        };
+
+        // Gives all memory back. Nodes that are still alive are not
+        // destroyed, so the owner must destroy them first if T needs it.
+        ~NodePool() {
+            release();
+        };
+
+        void swap(NodePool & other) {
+            std::swap(slabs, other.slabs);
+            std::swap(freeList, other.freeList);
+            std::swap(freeTail, other.freeTail);
+            std::swap(cursor, other.cursor);
+            std::swap(end, other.end);
+            std::swap(spares, other.spares);
+            std::swap(slabSize, other.slabSize);
+            std::swap(live, other.live);
+        };
+
+        // Constructs a new node with the given constructor arguments.
+        // Recycled nodes are used first. Amortized constant time, O(1).
+        template<class... Args>
+        T * create(Args &&... args) {
+            Slot * slot;
+            if (freeList) {
+                slot = freeList;
+                freeList = freeList->next;
+            }
+            else {
+                if (cursor == end && !spares.empty()) {
+                    cursor = spares.back().first;
+                    end = spares.back().second;
+                    spares.pop_back();
+                }
+                if (cursor == end) {
+                    grow(slabSize);
+                    if (slabSize < maxSlabSize)
+                        slabSize *= 2;
+                }
+                slot = cursor++;
+            }
+            T * x = new (slot->storage) T(std::forward<Args>(args)...);
+            live++;
+            return x;
+        };
+
+        // Destroys the node x and puts it on the free list.
+        // Constant time, O(1).
+        void destroy(T * x) {
+            x->~T();
+            push_free(reinterpret_cast<Slot *>(x));
+            live--;
+        };
+
+        // Makes sure that the next n calls to create() are served from a
+        // single slab without going to the system allocator.
+        void reserve(long n) {
+            if (end - cursor < n)
+                grow(n);
+        };
+
+        // Gives every slab back at once without running any destructors.
+        // The owner must have destroyed the live nodes already if T needs it.
+        // Linear in the number of slabs.
+        void clear() {
+            release();
+            freeList = NULL;
+            freeTail = NULL;
+            cursor = NULL;
+            end = NULL;
+            spares.clear();
+            live = 0;
+        };
+
+        // Takes over all slabs of other, with the nodes that live in them,
+        // and leaves other empty. Nodes created by other can then be
+        // destroyed through this pool. Nothing is copied.
+        // Linear in the number of slabs of other.
+        void adopt(NodePool & other) {
+            if (this == &other)
+                return;
+            slabs.insert(slabs.end(), other.slabs.begin(), other.slabs.end());
+            spares.insert(spares.end(), other.spares.begin(), other.spares.end());
+            if (other.cursor != other.end)
+                spares.push_back(std::make_pair(other.cursor, other.end));
+            if (other.freeList) {
+                other.freeTail->next = freeList;
+                if (!freeList)
+                    freeTail = other.freeTail;
+                freeList = other.freeList;
+            }
+            live += other.live;
+            other.slabs.clear();
+            other.spares.clear();
+            other.freeList = NULL;
+            other.freeTail = NULL;
+            other.cursor = NULL;
+            other.end = NULL;
+            other.live = 0;
+        };
+
+        // Returns the number of nodes currently handed out.
+        long size() {
+            return live;
+        };
+};
+
+#endif
@@ -8,25 +8,105 @@
 #include <cassert>
 #include <cstdlib>
 #include <ctime>
+#include <vector>
+#include <utility>
+#include <set>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
 
 #include "trees/bst.h"
 #include "trees/rb.h"
 #include "trees/llrb.h"
+#include "trees/bplus.h"
+#include "trees/compact_llrb.h"
+#include "trees/static_index.h"
+#include "trees/concurrent_rb.h"
+#include "trees/persistent_llrb.h"
 #include "lists/linked_list.h"
+#include "lists/unrolled_list.h"
+#include "lists/intrusive_list.h"
+#include "lists/concurrent_queue.h"
+#include "lists/skip_list.h"
+#include "lists/cache.h"
 #include "heaps/heap.h"
+#include "heaps/indexed_heap.h"
+#include "heaps/pairing_heap.h"
+#include "heaps/multi_queue.h"
+#include "heaps/top_k.h"
+#include "heaps/external_sort.h"
+#include "heaps/radix_heap.h"
+#include <iterator>
 
 using namespace std;
 
 void test_lists();
+void test_concurrent_lists();
 void test_trees();
+void test_concurrent_trees();
 void test_heaps();
+void test_concurrent_heaps();
 
 int main() {
     test_trees();
+    test_concurrent_trees();
     test_lists();
+    test_concurrent_lists();
     test_heaps();
+    test_concurrent_heaps();
 };
 
+// An object that can be in two intrusive lists at a time.
+struct Task {
+    int id;
+    IntrusiveListHook hook;
+    IntrusiveListHook recent;
+
+    Task(int id) : id(id) {};
+};
+
+ostream & operator<<(ostream & os, const Task & task) {
+    return os << task.id;
+}
+
+// A value that can be moved but not copied.
+struct Boxed {
+    unique_ptr<long> value;
+
+    Boxed(long value) : value(new long(value)) {};
+
+    bool operator>(const Boxed & other) const {
+        return *value > *other.value;
+    };
+};
+
+// Dijkstra from node 0 with a D-ary Heap and lazy deletion. Distances are
+// negated, since Heap is a max-heap.
+template<int D>
+vector<long> lazy_dijkstra(vector<vector<pair<long, long> > > & graph) {
+    vector<long> distance(graph.size(), 1L << 60);
+    Heap<pair<long, long>, D> frontier;
+    distance[0] = 0;
+    frontier.push(make_pair(0L, 0L));
+    while (!frontier.empty()) {
+        pair<long, long> top = frontier.pop();
+        long u = top.second;
+        if (-top.first > distance[u])
+            continue;
+        for (size_t e = 0; e < graph[u].size(); e++) {
+            long v = graph[u][e].first;
+            long d = distance[u] + graph[u][e].second;
+            if (d < distance[v]) {
+                distance[v] = d;
+                frontier.push(make_pair(-d, v));
+            }
+        }
+    }
+    return distance;
+}
+
 void test_heaps() {
     cout << "---- Testing Heap ----" << endl;
     long the_heap[] = { 4, 1, 2, 3, 5 };
@@ -60,19 +140,504 @@ void test_heaps() {
     assert (actual == expected);
     cout << "Ok" << endl;
 
-    int sizes[] = { 100000, 200000, 300000 };
+    // Use the heap as a priority queue with its own growing array.
+    cout << "Testing priority queue" << endl;
+    Heap<long> queue;
+    assert (queue.empty());
+    vector<long> pushed;
+    for (int i = 0; i < 10000; i++) {
+        long value = rand() % 1000;
+        queue.push(value);
+        pushed.push_back(value);
+        if (i % 3 == 0) {
+            sort(pushed.begin(), pushed.end());
+            assert (queue.top() == pushed.back());
+            assert (queue.pop() == pushed.back());
+            pushed.pop_back();
+        }
+    }
+    sort(pushed.begin(), pushed.end());
+    assert (queue.size() == (long)pushed.size());
+    while (!queue.empty()) {
+        assert (queue.pop() == pushed.back());
+        pushed.pop_back();
+    }
+
+    // Build a heap from a range, copy it and sort the copy.
+    long range[] = { 7, 3, 9, 1, 5, 8 };
+    Heap<long> range_heap(range, range + 6);
+    assert (range_heap.top() == 9);
+    Heap<long> range_copy(range_heap);
+    range_copy.heapSort();
+    assert (range_copy.printHeap() == "1\n3\n5\n7\n8\n9\n");
+    assert (range_heap.pop() == 9);
+    assert (range_heap.top() == 8);
+    range_copy.heapify();
+    range_copy.push(10);
+    assert (range_copy.pop() == 10);
+    assert (range_copy.pop() == 9);
+
+    // A heap on a caller's array moves to its own array when it grows.
+    long small_array[] = { 2, 6, 4 };
+    Heap<long> wrapped(small_array, 3, 3);
+    wrapped.heapify();
+    wrapped.push(5);
+    assert (small_array[0] == 6);
+    assert (wrapped.pop() == 6);
+    assert (wrapped.pop() == 5);
+    assert (small_array[0] == 6);
+
+    // Values that can only be moved.
+    Heap<Boxed> boxes;
+    for (long i = 0; i < 100; i++)
+        boxes.push(Boxed((i * 37) % 100));
+    for (long i = 99; i >= 0; i--)
+        assert (*boxes.pop().value == i);
+    cout << "Ok" << endl;
+
+    // Heaps with four and eight children per node, with values that have
+    // SIMD child selection and values that do not.
+    cout << "Testing d-ary heaps" << endl;
+    for (long n = 0; n < 100; n++) {
+        vector<long> longs;
+        vector<int> ints;
+        vector<unsigned> unsigneds;
+        vector<double> doubles;
+        vector<float> floats;
+        vector<string> strings;
+        for (long i = 0; i < n; i++) {
+            long value = rand() % 50 - 25;
+            longs.push_back(value);
+            ints.push_back(value);
+            unsigneds.push_back(value + 3000000000u);
+            doubles.push_back(value / 4.0);
+            floats.push_back(value / 4.0f);
+            strings.push_back(to_string(value));
+        }
+        Heap<long,4> long_heap(longs.data(), n, n);
+        Heap<int,8> int_heap(ints.data(), n, n);
+        Heap<unsigned,4> unsigned_heap(unsigneds.data(), n, n);
+        Heap<double,8> double_heap(doubles.data(), n, n);
+        Heap<float,4> float_heap(floats.data(), n, n);
+        Heap<string,3> string_heap(strings.data(), n, n);
+        long_heap.heapSort();
+        int_heap.bottomUpHeapSort();
+        unsigned_heap.heapSort();
+        double_heap.bottomUpHeapSort();
+        float_heap.heapSort();
+        string_heap.bottomUpHeapSort();
+        assert (is_sorted(longs.begin(), longs.end()));
+        assert (is_sorted(ints.begin(), ints.end()));
+        assert (is_sorted(unsigneds.begin(), unsigneds.end()));
+        assert (is_sorted(doubles.begin(), doubles.end()));
+        assert (is_sorted(floats.begin(), floats.end()));
+        assert (is_sorted(strings.begin(), strings.end()));
+    }
+    Heap<long,8> eight_queue;
+    for (long i = 0; i < 10000; i++)
+        eight_queue.push((i * 7919) % 10000);
+    for (long i = 9999; i >= 0; i--)
+        assert (eight_queue.pop() == i);
+    cout << "Ok" << endl;
+
+    // Change and remove values through their handles, checked against a
+    // plain array of the current values.
+    cout << "Testing indexed heap" << endl;
+    IndexedHeap<long> indexed;
+    vector<long> current;
+    vector<bool> alive;
+    for (int round = 0; round < 20000; round++) {
+        int op = rand() % 5;
+        if (op == 0 || indexed.empty()) {
+            long value = rand() % 1000;
+            long handle = indexed.push(value);
+            if (handle >= (long)current.size()) {
+                current.resize(handle + 1);
+                alive.resize(handle + 1);
+            }
+            assert (!alive[handle]);
+            current[handle] = value;
+            alive[handle] = true;
+        }
+        else {
+            long handle;
+            do {
+                handle = rand() % current.size();
+            } while (!alive[handle]);
+            assert (indexed.contains(handle));
+            assert (indexed.value(handle) == current[handle]);
+            if (op == 1) {
+                current[handle] += rand() % 100;
+                indexed.increase_key(handle, current[handle]);
+            }
+            else if (op == 2) {
+                current[handle] -= rand() % 100;
+                indexed.decrease_key(handle, current[handle]);
+            }
+            else if (op == 3) {
+                assert (indexed.erase(handle) == current[handle]);
+                alive[handle] = false;
+            }
+            else {
+                long largest = -1000000;
+                for (size_t i = 0; i < current.size(); i++) {
+                    if (alive[i] && current[i] > largest)
+                        largest = current[i];
+                }
+                handle = indexed.top_handle();
+                assert (indexed.top() == largest);
+                assert (current[handle] == largest);
+                assert (indexed.pop() == largest);
+                alive[handle] = false;
+                assert (!indexed.contains(handle));
+            }
+        }
+    }
+    long alive_count = 0;
+    for (size_t i = 0; i < alive.size(); i++)
+        alive_count += alive[i];
+    assert (indexed.size() == alive_count);
+    cout << "Ok" << endl;
+
+    cout << "Testing pairing heap" << endl;
+    PairingHeap<string> pairing;
+    PairingHeap<string>::Handle seven = pairing.push("7");
+    pairing.push("3");
+    PairingHeap<string>::Handle five = pairing.push("5");
+    pairing.push("9");
+    assert (pairing.top() == "9");
+    pairing.increase_key(five, "95");
+    assert (pairing.top() == "95");
+    assert (pairing.erase(seven) == "7");
+    assert (pairing.pop() == "95");
+    assert (pairing.pop() == "9");
+    assert (pairing.size() == 1);
+
+    // Melding shards, then changing and removing values through handles
+    // that were handed out by the shards.
+    vector<PairingHeap<long> *> shards;
+    vector<PairingHeap<long>::Handle> handles;
+    vector<long> melded_values;
+    for (int i = 0; i < 50; i++) {
+        shards.push_back(new PairingHeap<long>());
+        for (int j = 0; j < 200; j++) {
+            long value = rand() % 100000;
+            handles.push_back(shards[i]->push(value));
+            melded_values.push_back(value);
+        }
+    }
+    PairingHeap<long> melded;
+    for (int i = 0; i < 50; i++) {
+        melded.meld(*shards[i]);
+        assert (shards[i]->empty());
+        delete shards[i];
+    }
+    assert (melded.size() == 10000);
+    for (size_t i = 0; i < handles.size(); i += 3) {
+        if (i % 2 == 0) {
+            melded_values[i] += 1000;
+            melded.increase_key(handles[i], melded_values[i]);
+        }
+        else {
+            assert (melded.erase(handles[i]) == melded_values[i]);
+            melded_values[i] = -1;
+        }
+    }
+    sort(melded_values.begin(), melded_values.end());
+    while (!melded.empty()) {
+        assert (melded.pop() == melded_values.back());
+        melded_values.pop_back();
+    }
+    assert (melded_values.empty() || melded_values.back() == -1);
+    cout << "Ok" << endl;
+
+    // Merging many shards into one, against rebuilding an array heap.
+    {
+        const int shard_count = 100;
+        const int shard_size = 100;
+        vector<PairingHeap<long> *> pairing_shards;
+        vector<Heap<long> > array_shards(shard_count);
+        for (int i = 0; i < shard_count; i++) {
+            pairing_shards.push_back(new PairingHeap<long>());
+            for (int j = 0; j < shard_size; j++) {
+                long value = rand();
+                pairing_shards[i]->push(value);
+                array_shards[i].push(value);
+            }
+        }
+        PairingHeap<long> pairing_all;
+        for (int i = 0; i < shard_count; i++)
+            pairing_all.meld(*pairing_shards[i]);
+        vector<long> merged;
+        for (int i = 0; i < shard_count; i++) {
+            while (!array_shards[i].empty())
+                merged.push_back(array_shards[i].pop());
+        }
+        Heap<long> array_all(merged.begin(), merged.end());
+        assert (pairing_all.size() == array_all.size());
+        while (!array_all.empty())
+            assert (pairing_all.pop() == array_all.pop());
+        for (int i = 0; i < shard_count; i++)
+            delete pairing_shards[i];
+    }
+
+    // Dijkstra on a random graph: a pairing heap with increase_key against
+    // an array heap with lazy deletion, and the radix heap. The first two are
+    // max-heaps, so distances are negated.
+    {
+        const long nodes = 20000;
+        const long edges_per_node = 10;
+        vector<vector<pair<long, long> > > graph(nodes);
+        for (long u = 0; u < nodes; u++) {
+            for (long e = 0; e < edges_per_node; e++)
+                graph[u].push_back(make_pair(rand() % nodes, 1 + rand() % 1000));
+        }
+        const long infinity = 1L << 60;
+
+        vector<long> pairing_distance(nodes, infinity);
+        vector<PairingHeap<pair<long, long> >::Handle> in_queue(nodes, NULL);
+        vector<bool> done(nodes, false);
+        PairingHeap<pair<long, long> > frontier;
+        pairing_distance[0] = 0;
+        in_queue[0] = frontier.push(make_pair(0L, 0L));
+        while (!frontier.empty()) {
+            long u = frontier.pop().second;
+            done[u] = true;
+            for (size_t e = 0; e < graph[u].size(); e++) {
+                long v = graph[u][e].first;
+                long d = pairing_distance[u] + graph[u][e].second;
+                if (done[v] || d >= pairing_distance[v])
+                    continue;
+                pairing_distance[v] = d;
+                if (in_queue[v])
+                    frontier.increase_key(in_queue[v], make_pair(-d, v));
+                else
+                    in_queue[v] = frontier.push(make_pair(-d, v));
+            }
+        }
+        assert (pairing_distance == lazy_dijkstra<2>(graph));
+        assert (pairing_distance == lazy_dijkstra<4>(graph));
+
+        vector<long> radix_distance(nodes, infinity);
+        RadixHeap<unsigned long, long> radix_frontier;
+        radix_distance[0] = 0;
+        radix_frontier.push(0, 0);
+        while (!radix_frontier.empty()) {
+            pair<unsigned long, long> top = radix_frontier.pop();
+            long u = top.second;
+            if ((long)top.first > radix_distance[u])
+                continue;
+            for (size_t e = 0; e < graph[u].size(); e++) {
+                long v = graph[u][e].first;
+                long d = radix_distance[u] + graph[u][e].second;
+                if (d < radix_distance[v]) {
+                    radix_distance[v] = d;
+                    radix_frontier.push(d, v);
+                }
+            }
+        }
+        assert (pairing_distance == radix_distance);
+    }
+
+    cout << "Testing radix heap" << endl;
+    {
+        RadixHeap<unsigned, long> radix;
+        multiset<unsigned> expected;
+        unsigned now = 0;
+        for (int i = 0; i < 20000; i++) {
+            if (rand() % 3 > 0 || expected.empty()) {
+                unsigned key = now + (rand() % 4 == 0 ? 0 : rand() % (1 << (rand() % 24)));
+                radix.push(key, i);
+                expected.insert(key);
+            }
+            else {
+                assert (radix.top_key() == *expected.begin());
+                now = radix.pop().first;
+                assert (now == *expected.begin());
+                expected.erase(expected.begin());
+            }
+            assert (radix.size() == (long)expected.size());
+        }
+        while (!radix.empty()) {
+            assert (radix.pop().first == *expected.begin());
+            expected.erase(expected.begin());
+        }
+        assert (expected.empty());
+
+        bool thrown = false;
+        radix.clear();
+        radix.push(10, 0);
+        radix.pop();
+        try {
+            radix.push(9, 0);
+        }
+        catch (const invalid_argument &) {
+            thrown = true;
+        }
+        assert (thrown);
+        radix.push(10, 0);
+        assert (radix.top_key() == 10);
+    }
+    cout << "Ok" << endl;
+
+    cout << "Testing top-k and k-way merge" << endl;
+    for (long k = 0; k < 40; k += 3) {
+        vector<long> stream;
+        for (int i = 0; i < 1000; i++)
+            stream.push_back(rand() % 300);
+        TopK<long> one_by_one(k);
+        TopK<long,4> batched(k);
+        for (size_t i = 0; i < stream.size(); i++)
+            one_by_one.push(stream[i]);
+        batched.push(stream.begin(), stream.begin() + 500);
+        batched.push(stream.begin() + 500, stream.end());
+        sort(stream.rbegin(), stream.rend());
+        stream.resize(k);
+        assert (one_by_one.values() == stream);
+        assert (batched.values() == stream);
+    }
+
+    vector<vector<long> > runs(7);
+    vector<long> all_runs;
+    for (size_t r = 0; r < runs.size(); r++) {
+        for (size_t i = 0; i < r * 50; i++)
+            runs[r].push_back(rand() % 1000);
+        sort(runs[r].begin(), runs[r].end());
+        all_runs.insert(all_runs.end(), runs[r].begin(), runs[r].end());
+    }
+    sort(all_runs.begin(), all_runs.end());
+    KWayMerge<vector<long>::iterator> run_merge;
+    for (size_t r = 0; r < runs.size(); r++)
+        run_merge.add(runs[r].begin(), runs[r].end());
+    vector<long> merged_runs;
+    run_merge.merge(back_inserter(merged_runs));
+    assert (merged_runs == all_runs);
+
+    // Sequences can also be streams.
+    istringstream first_stream("1 4 9 16"), second_stream("2 3 5 7 11 13");
+    KWayMerge<istream_iterator<int> > stream_merge;
+    stream_merge.add(istream_iterator<int>(first_stream), istream_iterator<int>());
+    stream_merge.add(istream_iterator<int>(second_stream), istream_iterator<int>());
+    ostringstream merged_stream;
+    stream_merge.merge(ostream_iterator<int>(merged_stream, " "));
+    assert (merged_stream.str() == "1 2 3 4 5 7 9 11 13 16 ");
+    cout << "Ok" << endl;
+
+    cout << "Testing external sort" << endl;
+    {
+        string input = "/tmp/external_sort_input", output = "/tmp/external_sort_output";
+        const size_t record_size = 12;
+        for (long n = 0; n < 20000; n = n * 3 + 1) {
+            vector<string> records;
+            FILE * file = fopen(input.c_str(), "wb");
+            for (long i = 0; i < n; i++) {
+                string record(record_size, ' ');
+                for (size_t b = 0; b < record_size; b++)
+                    record[b] = 'a' + rand() % (b < 2 ? 3 : 26);
+                records.push_back(record);
+                fwrite(record.data(), 1, record_size, file);
+            }
+            fclose(file);
+
+            // Little memory and a small fan-in, so there are many runs and
+            // more than one merge pass.
+            ExternalSort sorter(record_size, 4096);
+            sorter.fan_in(3);
+            ExternalSort::Stats stats = sorter.sort(input, output);
+            sort(records.begin(), records.end());
+            file = fopen(output.c_str(), "rb");
+            vector<string> sorted;
+            char record[record_size];
+            while (fread(record, 1, record_size, file) == record_size)
+                sorted.push_back(string(record, record_size));
+            fclose(file);
+            assert (sorted == records);
+            assert (stats.records == n);
+            assert (stats.bytesRead == stats.bytesWritten);
+            assert (stats.bytesRead == (long)(n * record_size * stats.passes));
+            if (n > 3000)
+                assert (stats.passes > 2);
+            // A single run is renamed to the output without a merge.
+            assert ((stats.runs == 1) == (stats.passes == 1));
+
+            // Sorting on the first two bytes only.
+            ExternalSort by_key(record_size, 4096);
+            by_key.key(0, 2);
+            by_key.sort(input, output);
+            file = fopen(output.c_str(), "rb");
+            string previous;
+            while (fread(record, 1, record_size, file) == record_size) {
+                string current(record, record_size);
+                assert (previous.compare(0, 2, current, 0, 2) <= 0);
+                previous = current;
+            }
+            fclose(file);
+        }
+
+        // A file that ends in the middle of a record is not sorted.
+        FILE * file = fopen(input.c_str(), "wb");
+        fwrite("abcdefghijklmnopqrstuvwxy", 1, 25, file);
+        fclose(file);
+        ExternalSort partial(record_size, 4096);
+        bool thrown = false;
+        try {
+            partial.sort(input, output);
+        }
+        catch (const runtime_error &) {
+            thrown = true;
+        }
+        assert (thrown);
+
+        // A sort that fails after some runs were made closes all of them,
+        // so the same descriptors are free before and after.
+        file = fopen(input.c_str(), "wb");
+        for (long i = 0; i < 1000; i++) {
+            string record(record_size, 'a' + rand() % 26);
+            fwrite(record.data(), 1, record_size, file);
+        }
+        fclose(file);
+        auto free_descriptors = [&]() {
+            FILE * first = fopen(input.c_str(), "rb");
+            FILE * second = fopen(input.c_str(), "rb");
+            int descriptor = fileno(second);
+            fclose(second);
+            fclose(first);
+            return descriptor;
+        };
+        int free_descriptor = free_descriptors();
+        ExternalSort failing(record_size, 4096);
+        failing.temp_directory("/nonexistent_directory");
+        thrown = false;
+        try {
+            failing.sort(input, output);
+        }
+        catch (const runtime_error &) {
+            thrown = true;
+        }
+        assert (thrown);
+        assert (free_descriptors() == free_descriptor);
+        remove(input.c_str());
+        remove(output.c_str());
+    }
+    cout << "Ok" << endl;
+
+    // Both heap sorts agree with std::sort. Timing is in bench.cpp.
+    int sizes[] = { 1000, 2000, 3000 };
 
     for (int j = 0; j < 3; j++) {
         long size = sizes[j];
-        long big_heap[size];
+        vector<long> big_heap(size);
         for (long i = 0; i < size; i++)
             big_heap[i] = rand();
-        heap = * new Heap<long>(big_heap, size, size);
-        clock_t start = clock();
+        vector<long> bottom_up(big_heap);
+        vector<long> expected(big_heap);
+        sort(expected.begin(), expected.end());
+        heap = Heap<long>(big_heap.data(), size, size);
         heap.heapSort();
-        clock_t end = clock();
-	    double time = (double) (end-start) / CLOCKS_PER_SEC * 1000.0;
-        cout << size << " elements: " << time << endl;
+        heap = Heap<long>(bottom_up.data(), size, size);
+        heap.bottomUpHeapSort();
+        assert (big_heap == expected);
+        assert (bottom_up == expected);
     }
 };
 
@@ -115,7 +680,608 @@ void test_lists() {
     actual = ll.printList();
     assert (actual == expected);
 
+    // Removing the head and the tail relinks both directions.
+    ll.remove(1);
+    ll.remove(2);
+    assert (ll.empty());
+    assert (ll.begin() == ll.end());
+    ll.insert(5);
+    assert (ll.printList() == "5\n");
+    ll.remove(5);
+    assert (ll.printList() == "");
+
+    // Handles from insert.
+    LinkedList<int>::iterator two = ll.insert(2);
+    LinkedList<int>::iterator four = ll.insert(4);
+    ll.insert_before(two, 1);
+    ll.insert_after(two, 3);
+    ll.insert_after(four, 5);
+    assert (ll.printList() == "1\n2\n3\n4\n5\n");
+    assert (ll.size() == 5);
+    LinkedList<int>::iterator after = ll.erase(four);
+    assert (*after == 5);
+    ll.erase(ll.begin());
+    assert (ll.printList() == "2\n3\n5\n");
+    assert (ll.front() == 2 && ll.back() == 5);
+    assert (*--ll.end() == 5);
+    vector<int> backwards;
+    for (LinkedList<int>::iterator it = ll.end(); it != ll.begin(); )
+        backwards.push_back(*--it);
+    assert (backwards == vector<int>({5, 3, 2}));
+
+    // Moving nodes between lists keeps their handles.
+    LinkedList<int> other;
+    LinkedList<int>::iterator seven = other.insert(7);
+    other.insert(8);
+    ll.splice(ll.find(3), other, seven);
+    assert (ll.printList() == "2\n7\n3\n5\n");
+    assert (other.printList() == "8\n");
+    ll.splice(ll.begin(), ll, ll.find(5));
+    assert (ll.printList() == "5\n2\n7\n3\n");
+    ll.splice(ll.end(), other);
+    assert (other.empty() && other.begin() == other.end());
+    ll.erase(seven);
+    assert (ll.printList() == "5\n2\n3\n8\n");
+    assert (ll.size() == 4);
+    assert (ll.contains(8) && !ll.contains(7));
+
+    // A handle into nodes that were moved to another list steps back from
+    // the end of the list it is in now.
+    LinkedList<int> spliced;
+    LinkedList<int>::iterator nine = spliced.insert(9);
+    spliced.insert(10);
+    other.splice(other.end(), spliced);
+    LinkedList<int>::iterator h = nine;
+    ++h;
+    ++h;
+    assert (h == other.end());
+    assert (*--h == 10);
+    LinkedList<int> moved(std::move(other));
+    h = nine;
+    ++h;
+    ++h;
+    assert (h == moved.end() && *--h == 10);
+    other.swap(moved);
+    assert (moved.empty() && other.printList() == "9\n10\n");
+    h = nine;
+    h++;
+    h++;
+    assert (h == other.end() && *--h == 10 && *--h == 9 && --h == other.end());
+
+    LinkedList<int> copy(ll);
+    copy.remove(8);
+    assert (copy.printList() == "5\n2\n3\n");
+    assert (ll.printList() == "5\n2\n3\n8\n");
+    ll.clear();
+    assert (ll.size() == 0);
+
     cout << "Linked lists OK" << endl;
+
+    cout << "Testing intrusive list" << endl;
+    vector<Task> tasks;
+    for (int i = 0; i < 6; i++)
+        tasks.push_back(Task(i));
+    IntrusiveList<Task, offsetof(Task, hook)> queue;
+    IntrusiveList<Task, offsetof(Task, hook)> waiting;
+    IntrusiveList<Task, offsetof(Task, recent)> recent;
+    for (int i = 0; i < 6; i++) {
+        queue.push_back(tasks[i]);
+        recent.push_front(tasks[i]);
+    }
+    assert (queue.printList() == "0\n1\n2\n3\n4\n5\n");
+    assert (recent.printList() == "5\n4\n3\n2\n1\n0\n");
+
+    // Removing an object only needs the object.
+    queue.erase(tasks[3]);
+    assert (!tasks[3].hook.linked());
+    assert (tasks[3].recent.linked());
+    queue.insert_after(queue.iterator_to(tasks[4]), tasks[3]);
+    queue.move_to_front(tasks[5]);
+    recent.move_to_front(tasks[0]);
+    assert (queue.printList() == "5\n0\n1\n2\n4\n3\n");
+    assert (recent.printList() == "0\n5\n4\n3\n2\n1\n");
+    assert (recent.pop_back().id == 1);
+    assert (recent.size() == 5);
+
+    waiting.splice(waiting.end(), queue, tasks[2]);
+    waiting.push_front(queue.pop_front());
+    assert (waiting.printList() == "5\n2\n");
+    queue.splice(queue.begin(), waiting);
+    assert (waiting.empty());
+    assert (queue.printList() == "5\n2\n0\n1\n4\n3\n");
+    queue.move_to_back(tasks[5]);
+    assert (queue.back().id == 5 && queue.front().id == 2);
+    vector<int> ids;
+    for (IntrusiveList<Task, offsetof(Task, hook)>::iterator it = queue.end(); it != queue.begin(); )
+        ids.push_back((--it)->id);
+    assert (ids == vector<int>({5, 3, 4, 1, 0, 2}));
+    queue.erase(queue.begin());
+    assert (queue.size() == 5);
+
+    // A copy of an object is not linked.
+    Task copied(tasks[0]);
+    assert (!copied.hook.linked());
+    queue.clear();
+    recent.clear();
+    assert (!tasks[0].hook.linked() && !tasks[0].recent.linked());
+    cout << "Intrusive list OK" << endl;
+
+    cout << "Testing unrolled list" << endl;
+    UnrolledList<int> ul;
+    assert (ul.printList() == "");
+    ul.insert(1);
+    ul.insert(3);
+    ul.insert(2);
+    ul.remove(4);
+    assert (ul.printList() == "1\n3\n2\n");
+    ul.remove(3);
+    assert (ul.printList() == "1\n2\n");
+    assert (ul.contains(2));
+    assert (!ul.contains(3));
+
+    // Random inserts and removes against a vector, with 32-bit, 64-bit and
+    // non-integral values.
+    UnrolledList<int> ints;
+    UnrolledList<long, 128> longs;
+    UnrolledList<string> strings;
+    vector<int> reference;
+    for (int i = 0; i < 20000; i++) {
+        int value = rand() % 500;
+        if (rand() % 5 < 3) {
+            ints.insert(value);
+            longs.insert(value);
+            strings.insert(to_string(value));
+            reference.push_back(value);
+        }
+        else {
+            vector<int>::iterator it = find(reference.begin(), reference.end(), value);
+            assert (ints.contains(value) == (it != reference.end()));
+            ints.remove(value);
+            longs.remove(value);
+            strings.remove(to_string(value));
+            if (it != reference.end())
+                reference.erase(it);
+        }
+    }
+    assert (ints.size() == (long)reference.size());
+    assert (vector<int>(ints.begin(), ints.end()) == reference);
+    assert (vector<long>(longs.begin(), longs.end()) ==
+            vector<long>(reference.begin(), reference.end()));
+    long position = 0;
+    for (UnrolledList<string>::iterator it = strings.begin(); it != strings.end(); ++it)
+        assert (*it == to_string(reference[position++]));
+    assert (position == (long)reference.size());
+    while (!reference.empty()) {
+        longs.remove(reference.back());
+        reference.pop_back();
+    }
+    assert (longs.empty());
+    assert (longs.begin() == longs.end());
+    strings.clear();
+    assert (strings.size() == 0);
+
+    cout << "Unrolled list OK" << endl;
+
+    cout << "Testing skip list" << endl;
+    SkipList<int,string> skip;
+    assert (skip.empty());
+    assert (skip.begin() == skip.end());
+    assert (skip.find(1) == skip.end());
+    assert (!skip.erase(1));
+    skip.insert(2, "second");
+    skip.insert(3, "third");
+    skip.insert(1, "first");
+    assert (skip.inorder_tree_walk() == "1: first\n2: second\n3: third\n");
+    assert (skip.iterative_tree_search(2) == "second");
+    assert (skip.iterative_tree_search(4) == "");
+    assert (skip.tree_minimum() == 1);
+    assert (skip.tree_maximum() == 3);
+    assert (skip.erase(2));
+    assert (!skip.contains(2));
+    assert (skip.size() == 2);
+    skip.clear();
+    assert (skip.empty());
+    skip.insert(5, "fifth");
+    assert (skip.find(5)->value == "fifth");
+
+    // Random inserts, with repeated keys, and erases, checked against a
+    // red-black tree.
+    SkipList<int,int> skip_ints;
+    RB<int,int> skip_check;
+    for (int i = 0; i < 20000; i++) {
+        int key = rand() % 5000;
+        if (rand() % 3) {
+            skip_ints.insert(key, i);
+            skip_check.insert(key, i);
+        }
+        else
+            assert (skip_ints.erase(key) == skip_check.erase(key));
+    }
+    assert (skip_ints.size() == skip_check.size());
+    assert (skip_ints.tree_minimum() == skip_check.tree_minimum());
+    assert (skip_ints.tree_maximum() == skip_check.tree_maximum());
+    for (int key = -1; key <= 5000; key += 7) {
+        assert (skip_ints.contains(key) == (skip_check.find(key) != skip_check.end()));
+        SkipList<int,int>::iterator lower = skip_ints.lower_bound(key);
+        RB<int,int>::iterator check_lower = skip_check.lower_bound(key);
+        assert ((lower == skip_ints.end()) == (check_lower == skip_check.end()));
+        if (lower != skip_ints.end())
+            assert (lower->key == check_lower->key);
+        SkipList<int,int>::iterator upper = skip_ints.upper_bound(key);
+        RB<int,int>::iterator check_upper = skip_check.upper_bound(key);
+        assert ((upper == skip_ints.end()) == (check_upper == skip_check.end()));
+        if (upper != skip_ints.end())
+            assert (upper->key == check_upper->key);
+    }
+    long scanned = 0;
+    int previous_key = -1;
+    skip_ints.range_scan(1000, 2000, [&](int key, int) {
+        assert (key >= 1000 && key <= 2000 && key >= previous_key);
+        previous_key = key;
+        scanned++;
+    });
+    assert (scanned == skip_check.count_range(1000, 2000));
+    assert (skip_ints.height() >= 1 && skip_ints.height() <= SKIP_LIST_LEVELS);
+    while (!skip_ints.empty())
+        assert (skip_ints.erase(skip_ints.tree_minimum()));
+    assert (skip_ints.height() == 1);
+
+    cout << "Skip list OK" << endl;
+
+    cout << "Testing cache" << endl;
+    Cache<int,string> lru(3);
+    assert (lru.empty());
+    assert (lru.get(1) == NULL);
+    lru.put(1, "one");
+    lru.put(2, "two");
+    lru.put(3, "three");
+    assert (lru.size() == 3);
+    assert (*lru.get(1) == "one");
+    assert (lru.next_victim() == 2);
+    lru.put(4, "four");
+    assert (!lru.contains(2));
+    assert (lru.contains(1) && lru.contains(3) && lru.contains(4));
+    lru.put(3, "drei");
+    assert (*lru.get(3) == "drei");
+    assert (lru.next_victim() == 1);
+    assert (lru.erase(1));
+    assert (!lru.erase(1));
+    assert (lru.size() == 2);
+    Cache<int,string>::Stats stats = lru.stats();
+    assert (stats.hits == 2 && stats.misses == 1 && stats.evictions == 1);
+    assert (stats.hit_rate() == 2.0 / 3);
+    lru.reset_stats();
+    assert (lru.stats().hits == 0);
+    lru.clear();
+    assert (lru.empty());
+    assert (lru.bytes() == 0);
+
+    // The size in bytes limits the cache too. An entry that grows pushes
+    // out others, but never itself.
+    Cache<int,int> sized(10, 100);
+    sized.put(1, 1, 40);
+    sized.put(2, 2, 40);
+    sized.put(3, 3, 40);
+    assert (!sized.contains(1));
+    assert (sized.bytes() == 80);
+    assert (!sized.put(4, 4, 101));
+    assert (!sized.contains(4));
+    assert (sized.put(2, 2, 90));
+    assert (sized.contains(2) && !sized.contains(3));
+    assert (sized.bytes() == 90);
+    assert (sized.stats().evictions == 2);
+
+    // Least frequently used: ties go to the one used longest ago.
+    Cache<int,int,LEAST_FREQUENTLY_USED> lfu(3);
+    lfu.put(1, 1);
+    lfu.put(2, 2);
+    lfu.put(3, 3);
+    lfu.get(1);
+    lfu.get(1);
+    lfu.get(2);
+    lfu.put(4, 4);
+    assert (!lfu.contains(3));
+    lfu.put(5, 5);
+    assert (!lfu.contains(4));
+    assert (lfu.next_victim() == 5);
+    lfu.get(5);
+    lfu.get(5);
+    lfu.get(5);
+    assert (lfu.next_victim() == 2);
+
+    // Random puts, gets and erases against a plain model that looks for
+    // the victim by scanning every entry.
+    for (int policy = 0; policy < 2; policy++) {
+        Cache<int,int> recent(50, 2000);
+        Cache<int,int,LEAST_FREQUENTLY_USED> frequent(50, 2000);
+        // key -> value, bytes, uses, last use
+        map<int, vector<long> > model;
+        long used = 0;
+        for (long tick = 0; tick < 50000; tick++) {
+            int key = rand() % 120;
+            int action = rand() % 10;
+            if (action < 5) {
+                int * found = policy ? frequent.get(key) : recent.get(key);
+                assert ((found != NULL) == (model.count(key) > 0));
+                if (found) {
+                    assert (*found == model[key][0]);
+                    model[key][2]++;
+                    model[key][3] = tick;
+                }
+            }
+            else if (action < 9) {
+                long bytes = 1 + rand() % 80;
+                bool stored = policy ? frequent.put(key, (int)tick, bytes) :
+                    recent.put(key, (int)tick, bytes);
+                assert (stored);
+                if (model.count(key)) {
+                    used += bytes - model[key][1];
+                    model[key][0] = tick;
+                    model[key][1] = bytes;
+                    model[key][2]++;
+                    model[key][3] = tick;
+                }
+                else {
+                    model[key] = {tick, bytes, 1, tick};
+                    used += bytes;
+                }
+                while ((long)model.size() > 50 || used > 2000) {
+                    map<int, vector<long> >::iterator victim = model.end();
+                    for (map<int, vector<long> >::iterator it = model.begin();
+                         it != model.end(); ++it) {
+                        if (it->first == key)
+                            continue;
+                        if (victim == model.end() ||
+                            (policy && it->second[2] != victim->second[2] ?
+                             it->second[2] < victim->second[2] :
+                             it->second[3] < victim->second[3]))
+                            victim = it;
+                    }
+                    used -= victim->second[1];
+                    model.erase(victim);
+                }
+            }
+            else {
+                bool erased = policy ? frequent.erase(key) : recent.erase(key);
+                assert (erased == (model.count(key) > 0));
+                if (erased) {
+                    used -= model[key][1];
+                    model.erase(key);
+                }
+            }
+            assert ((policy ? frequent.size() : recent.size()) == (long)model.size());
+            assert ((long)(policy ? frequent.bytes() : recent.bytes()) == used);
+        }
+        for (int key = 0; key < 120; key++)
+            assert ((policy ? frequent.contains(key) : recent.contains(key)) ==
+                    (model.count(key) > 0));
+    }
+
+    cout << "Cache OK" << endl;
+};
+
+// Producers push the values producer * per_producer + i in order and
+// consumers pop until every value is out. Every value must come out exactly
+// once, and the values of one producer must come out in the order they were
+// pushed.
+template<class TQueue>
+void stress_queue(TQueue & queue, int producers, int consumers, long per_producer) {
+    atomic<long> popped_sum(0);
+    atomic<long> popped_count(0);
+    atomic<bool> in_order(true);
+    const long total = producers * per_producer;
+    vector<thread> workers;
+    for (int p = 0; p < producers; p++) {
+        workers.push_back(thread([&, p]() {
+            for (long i = 0; i < per_producer; i++)
+                queue.push(p * per_producer + i);
+        }));
+    }
+    for (int c = 0; c < consumers; c++) {
+        workers.push_back(thread([&]() {
+            vector<long> last(producers, -1);
+            long value;
+            while (popped_count.load() < total) {
+                if (!queue.try_pop(value)) {
+                    this_thread::yield();
+                    continue;
+                }
+                long p = value / per_producer;
+                if (value % per_producer <= last[p])
+                    in_order = false;
+                last[p] = value % per_producer;
+                popped_sum += value;
+                popped_count++;
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    assert (in_order.load());
+    assert (popped_count.load() == total);
+    assert (popped_sum.load() == total * (total - 1) / 2);
+    assert (queue.empty());
+};
+
+void test_concurrent_lists() {
+    cout << "---- Testing concurrent lists ----" << endl;
+    cout << "Testing bounded queue" << endl;
+
+    BoundedQueue<int> small(5);
+    assert (small.capacity() == 8);
+    assert (small.empty());
+    for (int i = 0; i < 8; i++)
+        assert (small.try_push(i));
+    assert (!small.try_push(8));
+    assert (small.size() == 8);
+    int value;
+    for (int i = 0; i < 8; i++) {
+        assert (small.try_pop(value));
+        assert (value == i);
+    }
+    assert (!small.try_pop(value));
+
+    // Values that own memory are moved in and out, and the ones left behind
+    // are destroyed with the queue.
+    {
+        BoundedQueue<string> strings(4);
+        strings.push("first");
+        strings.push("second");
+        strings.push("third");
+        string s;
+        assert (strings.try_pop(s));
+        assert (s == "first");
+    }
+
+    // A small ring, so producers keep finding it full and wrap around.
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        BoundedQueue<long> ring(64);
+        stress_queue(ring, threads, threads, 50000);
+    }
+    BoundedQueue<long> uneven(16);
+    stress_queue(uneven, 3, 1, 20000);
+    cout << "Bounded queue OK" << endl;
+
+    cout << "Testing linked queue" << endl;
+    LinkedQueue<int> queue;
+    assert (queue.empty());
+    assert (!queue.try_pop(value));
+    for (int i = 0; i < 1000; i++)
+        queue.push(i);
+    assert (!queue.empty());
+    for (int i = 0; i < 1000; i++) {
+        assert (queue.try_pop(value));
+        assert (value == i);
+    }
+    assert (!queue.try_pop(value));
+    assert (queue.empty());
+
+    {
+        LinkedQueue<string> strings;
+        strings.push("first");
+        strings.push("second");
+        string s;
+        assert (strings.try_pop(s));
+        assert (s == "first");
+    }
+
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        LinkedQueue<long> linked;
+        stress_queue(linked, threads, threads, 50000);
+    }
+    LinkedQueue<long> fan_in;
+    stress_queue(fan_in, 1, 3, 50000);
+    cout << "Linked queue OK" << endl;
+
+    cout << "Testing concurrent skip list" << endl;
+    ConcurrentSkipList<long,string> map;
+    assert (map.empty());
+    assert (map.insert(1, "one"));
+    assert (!map.insert(1, "uno"));
+    assert (map.iterative_tree_search(1) == "one");
+    assert (map.erase(1));
+    assert (!map.erase(1));
+    assert (!map.contains(1));
+
+    // The even keys stay in the map the whole time. Writers keep putting in
+    // and taking out the odd keys, each its own share of them, while the
+    // readers check that every even key is always found with the right
+    // value and that range scans come out sorted.
+    const long stable_keys = 20000;
+    for (long i = 0; i < stable_keys; i++)
+        assert (map.insert(2*i, to_string(2*i)));
+    atomic<bool> done(false);
+    atomic<long> failures(0);
+    vector<thread> readers;
+    for (int t = 0; t < 2; t++) {
+        readers.push_back(thread([&, t]() {
+            unsigned seed = t;
+            while (!done.load()) {
+                long key = 2 * (rand_r(&seed) % stable_keys);
+                string value;
+                if (!map.find(key, value) || value != to_string(key))
+                    failures++;
+                long previous = key - 1;
+                long even_count = 0;
+                map.range_scan(key, key + 200, [&](long k, const string & v) {
+                    if (k <= previous || v != to_string(k))
+                        failures++;
+                    if (k % 2 == 0)
+                        even_count++;
+                    previous = k;
+                });
+                if (even_count != min(101L, stable_keys - key / 2))
+                    failures++;
+            }
+        }));
+    }
+    vector<thread> writers;
+    for (int t = 0; t < 4; t++) {
+        writers.push_back(thread([&, t]() {
+            for (int round = 0; round < 5; round++) {
+                for (long i = t; i < stable_keys; i += 28) {
+                    if (!map.insert(2*i + 1, to_string(2*i + 1)))
+                        failures++;
+                }
+                for (long i = t; i < stable_keys; i += 28) {
+                    if (!map.erase(2*i + 1))
+                        failures++;
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < writers.size(); t++)
+        writers[t].join();
+    done.store(true);
+    for (size_t t = 0; t < readers.size(); t++)
+        readers[t].join();
+    assert (failures.load() == 0);
+    assert (map.size() == stable_keys);
+    assert (!map.contains(43));
+
+    // All threads fight over the same few keys. Per key, the inserts and
+    // erases that succeeded must add up to whether it is there at the end.
+    {
+        const int keys = 64;
+        ConcurrentSkipList<long,long> contended;
+        vector<atomic<long> > balance(keys);
+        for (int k = 0; k < keys; k++)
+            balance[k].store(0);
+        vector<thread> workers;
+        for (int t = 0; t < 4; t++) {
+            workers.push_back(thread([&, t]() {
+                unsigned seed = t;
+                for (int i = 0; i < 50000; i++) {
+                    long key = rand_r(&seed) % keys;
+                    if (rand_r(&seed) % 2) {
+                        if (contended.insert(key, key))
+                            balance[key]++;
+                    }
+                    else if (contended.erase(key))
+                        balance[key]--;
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+        long present = 0;
+        for (int k = 0; k < keys; k++) {
+            assert (balance[k].load() == (contended.contains(k) ? 1 : 0));
+            present += balance[k].load();
+        }
+        assert (contended.size() == present);
+        long previous = -1;
+        contended.range_scan(0, keys, [&](long k, long v) {
+            assert (k > previous && k == v);
+            previous = k;
+        });
+    }
+
+    map.clear();
+    assert (map.empty());
+    assert (map.insert(7, "seven"));
+    assert (map.contains(7));
+    cout << "Concurrent skip list OK" << endl;
 };
 
 void test_trees() {
@@ -150,7 +1316,7 @@ void test_trees() {
     assert (actual == expected);
 
     // Insert backwards ordered. This also gives worst case (maximum height).
-    my_tree = * new BST<int,string>;
+    my_tree.clear();
     my_tree.insert(5,"fifth");
     assert (my_tree.height() == 0);
     my_tree.insert(4,"fourth");
@@ -167,7 +1333,7 @@ void test_trees() {
     assert (actual == expected);
 
     // Insert "randomly". This gives a better height.
-    my_tree = * new BST<int,string>;
+    my_tree.clear();
     my_tree.insert(3,"third");
     assert (my_tree.height() == 0);
     my_tree.insert(1,"first");
@@ -198,7 +1364,7 @@ void test_trees() {
     assert (actual == expected);
 
     // Insert backwards ordered
-    my_rb_tree = * new RB<int,string>;
+    my_rb_tree.clear();
     my_rb_tree.insert(5,"fifth");
     my_rb_tree.insert(4,"fourth");
     my_rb_tree.insert(3,"third");
@@ -208,7 +1374,7 @@ void test_trees() {
     assert (actual == expected);
 
     // Insert "randomly"
-    my_rb_tree = * new RB<int,string>;
+    my_rb_tree.clear();
     my_rb_tree.insert(3,"third");
     my_rb_tree.insert(1,"first");
     my_rb_tree.insert(5,"fifth");
@@ -222,7 +1388,7 @@ void test_trees() {
     double max_height = 2*log2((double)(array_size+1));
     cout << "With " << array_size << " elements, max height should be: " << max_height << endl;
 
-    my_rb_tree = * new RB<int,string>;
+    my_rb_tree.clear();
     int keys [array_size];
     for (int i = 0; i < array_size; i++) {
         my_rb_tree.insert(i, "");
@@ -238,7 +1404,7 @@ void test_trees() {
 
     // Try and shuffle the elements and make another big tree.
     random_shuffle(&keys[0], &keys[array_size-1]);
-    my_rb_tree = * new RB<int,string>;
+    my_rb_tree.clear();
     for (int i = 0; i < array_size; i++) {
         my_rb_tree.insert(keys[i], "");
     }
@@ -265,7 +1431,7 @@ void test_trees() {
     assert (actual == expected);
 
     // Insert backwards ordered
-    my_llrb_tree = * new LLRB<int,string>;
+    my_llrb_tree.clear();
     my_llrb_tree.insert(5,"fifth");
     my_llrb_tree.insert(4,"fourth");
     my_llrb_tree.insert(3,"third");
@@ -275,7 +1441,7 @@ void test_trees() {
     assert (actual == expected);
 
     // Insert "randomly"
-    my_llrb_tree = * new LLRB<int,string>;
+    my_llrb_tree.clear();
     my_llrb_tree.insert(3,"third");
     my_llrb_tree.insert(1,"first");
     my_llrb_tree.insert(5,"fifth");
@@ -287,7 +1453,7 @@ void test_trees() {
     // Insert a lot to see if the height property holds.
     cout << "With " << array_size << " elements, max height should be: " << max_height << endl;
 
-    my_llrb_tree = * new LLRB<int,string>;
+    my_llrb_tree.clear();
     for (int i = 0; i < array_size; i++) {
         my_llrb_tree.insert(i, "");
         keys[i] = i;
@@ -302,7 +1468,7 @@ void test_trees() {
 
     // Try and shuffle the elements and make another big tree.
     random_shuffle(&keys[0], &keys[array_size-1]);
-    my_llrb_tree = * new LLRB<int,string>;
+    my_llrb_tree.clear();
     for (int i = 0; i < array_size; i++) {
         my_llrb_tree.insert(keys[i], "");
     }
@@ -315,4 +1481,681 @@ void test_trees() {
     assert (height <= max_height);
 
     cout << "LLRB OK" << endl;
+
+    // Test that copies are deep and that clearing gives an empty tree.
+    cout << "Testing tree copy and clear" << endl;
+    RB<int,string> rb_copy;
+    rb_copy.insert(2,"second");
+    my_rb_tree.clear();
+    my_rb_tree.insert(1,"first");
+    my_rb_tree.insert(3,"third");
+    rb_copy = my_rb_tree;
+    my_rb_tree.clear();
+    assert (my_rb_tree.inorder_tree_walk() == "");
+    assert (my_rb_tree.height() == -1);
+    assert (rb_copy.inorder_tree_walk() == "1: first\n3: third\n");
+    my_rb_tree.insert(4,"fourth");
+    assert (rb_copy.height() == 1);
+    assert (my_rb_tree.height() == 0);
+
+    // Test that the node pool recycles destroyed nodes.
+    NodePool<string> string_pool(2);
+    string * s1 = string_pool.create("one");
+    string * s2 = string_pool.create("two");
+    string_pool.destroy(s1);
+    string * s3 = string_pool.create("three");
+    assert (s3 == s1);
+    assert (*s2 == "two" && *s3 == "three");
+    assert (string_pool.size() == 2);
+    string_pool.destroy(s2);
+    string_pool.destroy(s3);
+    string_pool.clear();
+    assert (string_pool.size() == 0);
+
+    cout << "Tree copy and clear OK" << endl;
+
+    // Test bulk building from sorted keys and appending increasing keys.
+    cout << "Testing bulk build and append" << endl;
+    int mini_keys[] = { 1, 2, 3, 4, 5 };
+    string mini_values[] = { "first", "second", "third", "fourth", "fifth" };
+    my_rb_tree.build(mini_keys, mini_values, 5);
+    assert (my_rb_tree.inorder_tree_walk() == expected);
+    my_llrb_tree.build(mini_keys, mini_values, 5);
+    assert (my_llrb_tree.inorder_tree_walk() == expected);
+    my_rb_tree.build(mini_keys, mini_values, 0);
+    assert (my_rb_tree.height() == -1);
+
+    // Every size up to a few hundred must give a tree that is still
+    // balanced after more keys are inserted into it.
+    for (int n = 1; n < 300; n++) {
+        vector<pair<int,string> > sorted_pairs;
+        for (int i = 0; i < n; i++)
+            sorted_pairs.push_back(make_pair(2*i, ""));
+        my_rb_tree.build(sorted_pairs.begin(), sorted_pairs.end());
+        my_llrb_tree.build(sorted_pairs.begin(), sorted_pairs.end());
+        assert (my_rb_tree.height() <= 2*log2((double)(n+1)));
+        assert (my_llrb_tree.height() <= 2*log2((double)(n+1)));
+        for (int i = 0; i < n; i++) {
+            my_rb_tree.insert(2*i+1, "");
+            my_llrb_tree.insert(2*i+1, "");
+        }
+        assert (my_rb_tree.height() <= 2*log2((double)(2*n+1)));
+        assert (my_llrb_tree.height() <= 2*log2((double)(2*n+1)));
+        assert (my_rb_tree.tree_maximum() == 2*n-1);
+        assert (my_llrb_tree.tree_maximum() == 2*n-1);
+    }
+
+    vector<int> sorted_keys(array_size);
+    vector<string> sorted_values(array_size);
+    for (int i = 0; i < array_size; i++)
+        sorted_keys[i] = i;
+    my_rb_tree.build(sorted_keys.data(), sorted_values.data(), array_size);
+    my_llrb_tree.build(sorted_keys.data(), sorted_values.data(), array_size);
+    cout << "Tree height (bulk built): " << my_rb_tree.height() << endl;
+    assert (my_rb_tree.height() <= max_height);
+    assert (my_llrb_tree.height() <= max_height);
+    assert (my_rb_tree.tree_minimum() == 0);
+    assert (my_llrb_tree.tree_maximum() == (array_size-1));
+    assert (my_rb_tree.count_steps(array_size/3) > 0);
+    assert (my_llrb_tree.count_steps(array_size/3) > 0);
+
+    my_rb_tree.clear();
+    my_llrb_tree.clear();
+    for (int i = 0; i < array_size; i++) {
+        my_rb_tree.append(i, "");
+        my_llrb_tree.append(i, "");
+    }
+    assert (my_rb_tree.height() <= max_height);
+    assert (my_llrb_tree.height() <= max_height);
+    assert (my_rb_tree.tree_maximum() == (array_size-1));
+    assert (my_llrb_tree.tree_maximum() == (array_size-1));
+    my_rb_tree.insert(-1, "");
+    assert (my_rb_tree.tree_minimum() == -1);
+
+    cout << "Bulk build and append OK" << endl;
+
+    // Test iterators and range queries on all three trees.
+    cout << "Testing tree iterators" << endl;
+    my_tree.clear();
+    my_rb_tree.clear();
+    my_llrb_tree.clear();
+    for (int i = 0; i < array_size; i++) {
+        my_rb_tree.insert(keys[i], to_string(keys[i]));
+        my_llrb_tree.insert(keys[i], to_string(keys[i]));
+        if (i < 1000)
+            my_tree.insert(keys[i], to_string(keys[i]));
+    }
+
+    int expected_key = 0;
+    for (RB<int,string>::iterator it = my_rb_tree.begin(); it != my_rb_tree.end(); ++it) {
+        assert (it->key == expected_key);
+        assert (it->value == to_string(expected_key));
+        expected_key++;
+    }
+    assert (expected_key == array_size);
+
+    expected_key = array_size;
+    LLRB<int,string>::iterator llrb_it = my_llrb_tree.end();
+    while (llrb_it != my_llrb_tree.begin()) {
+        --llrb_it;
+        expected_key--;
+        assert (llrb_it->key == expected_key);
+    }
+    assert (expected_key == 0);
+
+    // The BST only got some of the keys, so check that they are sorted.
+    int previous_key = -1;
+    long bst_count = 0;
+    for (BST<int,string>::iterator it = my_tree.begin(); it != my_tree.end(); it++) {
+        assert (it->key > previous_key);
+        previous_key = it->key;
+        bst_count++;
+    }
+    assert (bst_count == 1000);
+
+    assert (my_rb_tree.find(42)->value == "42");
+    assert (my_rb_tree.find(array_size) == my_rb_tree.end());
+    assert (my_llrb_tree.lower_bound(-5)->key == 0);
+    assert (my_llrb_tree.upper_bound(41)->key == 42);
+    assert (my_llrb_tree.upper_bound(array_size-1) == my_llrb_tree.end());
+    my_rb_tree.insert(42, "another 42");
+    pair<RB<int,string>::iterator, RB<int,string>::iterator> range =
+        my_rb_tree.equal_range(42);
+    int range_count = 0;
+    for (RB<int,string>::iterator it = range.first; it != range.second; ++it)
+        range_count++;
+    assert (range_count == 2);
+    assert (range.second->key == 43);
+
+    long range_sum = 0;
+    my_llrb_tree.range_scan(100, 199, [&](int key, const string & value) {
+        assert (value == to_string(key));
+        range_sum += key;
+    });
+    assert (range_sum == 14950);
+    range_sum = 0;
+    my_llrb_tree.range_scan(array_size, array_size+10, [&](int, const string &) {
+        range_sum++;
+    });
+    assert (range_sum == 0);
+
+    cout << "Tree iterators OK" << endl;
+
+    // Test order statistics. The RB tree has the keys 0..array_size-1 and an
+    // extra 42, and the LLRB tree has the keys 0..array_size-1.
+    cout << "Testing order statistics" << endl;
+    assert (my_rb_tree.size() == array_size + 1);
+    assert (my_llrb_tree.size() == array_size);
+    assert (my_tree.size() == 1000);
+    for (int i = 1; i <= array_size; i += 997) {
+        assert (my_llrb_tree.select(i) == i - 1);
+        assert (my_llrb_tree.rank(i - 1) == i);
+    }
+    assert (my_rb_tree.select(43) == 42);
+    assert (my_rb_tree.select(44) == 42);
+    assert (my_rb_tree.select(45) == 43);
+    assert (my_rb_tree.rank(42) == 44);
+    assert (my_rb_tree.count_less(42) == 42);
+    assert (my_rb_tree.count_range(40, 44) == 6);
+    assert (my_rb_tree.count_range(44, 40) == 0);
+    assert (my_llrb_tree.count_range(-100, array_size + 100) == array_size);
+    assert (my_llrb_tree.rank(-1) == 0);
+    assert (my_tree.select(1) == my_tree.tree_minimum());
+    assert (my_tree.select(1000) == my_tree.tree_maximum());
+
+    // The stored heights must match the real heights after rebalancing.
+    my_rb_tree.clear();
+    for (int i = 0; i < 7; i++)
+        my_rb_tree.insert(i, "");
+    assert (my_rb_tree.height() == 3);
+    my_llrb_tree.clear();
+    my_llrb_tree.insert(1, "");
+    my_llrb_tree.insert(2, "");
+    my_llrb_tree.insert(3, "");
+    assert (my_llrb_tree.height() == 1);
+    my_rb_tree.build(sorted_keys.data(), sorted_values.data(), 7);
+    assert (my_rb_tree.height() == 2);
+    assert (my_rb_tree.size() == 7);
+    rb_copy = my_rb_tree;
+    assert (rb_copy.size() == 7);
+    assert (rb_copy.select(4) == 3);
+
+    cout << "Order statistics OK" << endl;
+
+    // Test deletion. Insert and erase random keys and compare with a
+    // multiset after every round.
+    cout << "Testing deletion" << endl;
+    my_rb_tree.clear();
+    my_llrb_tree.clear();
+    assert (!my_rb_tree.erase(1));
+    assert (!my_llrb_tree.erase(1));
+    multiset<int> reference;
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 2000; i++) {
+            int key = rand() % 3000;
+            if (rand() % 10 < 6) {
+                my_rb_tree.insert(key, to_string(key));
+                my_llrb_tree.insert(key, to_string(key));
+                reference.insert(key);
+            }
+            else {
+                bool found = reference.find(key) != reference.end();
+                if (found)
+                    reference.erase(reference.find(key));
+                assert (my_rb_tree.erase(key) == found);
+                assert (my_llrb_tree.erase(key) == found);
+            }
+        }
+        assert (my_rb_tree.size() == (long)reference.size());
+        assert (my_llrb_tree.size() == (long)reference.size());
+        double bound = 2*log2((double)(reference.size()+1));
+        assert (my_rb_tree.height() <= bound);
+        assert (my_llrb_tree.height() <= bound);
+        multiset<int>::iterator ref_it = reference.begin();
+        RB<int,string>::iterator rb_it = my_rb_tree.begin();
+        LLRB<int,string>::iterator llrb_it2 = my_llrb_tree.begin();
+        for (; ref_it != reference.end(); ++ref_it, ++rb_it, ++llrb_it2) {
+            assert (rb_it->key == *ref_it);
+            assert (llrb_it2->key == *ref_it);
+            assert (rb_it->value == to_string(*ref_it));
+        }
+        assert (rb_it == my_rb_tree.end());
+        assert (llrb_it2 == my_llrb_tree.end());
+    }
+
+    // Erase every other node through iterators, then everything.
+    long before = my_llrb_tree.size();
+    for (LLRB<int,string>::iterator it = my_llrb_tree.begin(); it != my_llrb_tree.end(); ) {
+        it = my_llrb_tree.erase(it);
+        if (it != my_llrb_tree.end())
+            ++it;
+    }
+    for (RB<int,string>::iterator it = my_rb_tree.begin(); it != my_rb_tree.end(); ) {
+        it = my_rb_tree.erase(it);
+        if (it != my_rb_tree.end())
+            ++it;
+    }
+    assert (my_llrb_tree.size() == before / 2);
+    assert (my_rb_tree.size() == before / 2);
+    while (my_rb_tree.size() > 0)
+        my_rb_tree.erase(my_rb_tree.begin());
+    while (my_llrb_tree.size() > 0)
+        my_llrb_tree.erase(my_llrb_tree.tree_maximum());
+    assert (my_rb_tree.height() == -1);
+    assert (my_llrb_tree.begin() == my_llrb_tree.end());
+
+    cout << "Deletion OK" << endl;
+
+    // Test B+tree.
+    cout << "Testing B+tree" << endl;
+    BPlusTree<int,string> my_bplus_tree;
+    assert (my_bplus_tree.height() == -1);
+    my_bplus_tree.insert(3,"third");
+    my_bplus_tree.insert(1,"first");
+    my_bplus_tree.insert(5,"fifth");
+    my_bplus_tree.insert(2,"second");
+    my_bplus_tree.insert(4,"fourth");
+    assert (my_bplus_tree.height() == 0);
+    actual = my_bplus_tree.inorder_tree_walk();
+    assert (actual == expected);
+    assert (my_bplus_tree.iterative_tree_search(4) == "fourth");
+    assert (my_bplus_tree.iterative_tree_search(6) == "");
+
+    // Insert a lot of shuffled keys so the tree gets a few levels.
+    BPlusTree<long,long> big_bplus_tree;
+    for (int i = 0; i < array_size; i++)
+        big_bplus_tree.insert(keys[i], keys[i] * 2);
+    assert (big_bplus_tree.size() == array_size);
+    assert (big_bplus_tree.tree_minimum() == 0);
+    assert (big_bplus_tree.tree_maximum() == (array_size-1));
+    assert (big_bplus_tree.height() >= 2);
+    for (int i = 0; i < array_size; i++) {
+        assert (big_bplus_tree.contains(i));
+        assert (big_bplus_tree.iterative_tree_search(i) == 2 * i);
+    }
+    assert (!big_bplus_tree.contains(-1));
+    assert (!big_bplus_tree.contains(array_size));
+
+    // Scan a range through the linked leaves.
+    long scan_sum = 0;
+    long scan_count = 0;
+    big_bplus_tree.range_scan(1000, 1999, [&](long key, long) {
+        assert (key == 1000 + scan_count);
+        scan_sum += key;
+        scan_count++;
+    });
+    assert (scan_count == 1000);
+    assert (scan_sum == 1499500);
+
+    // Unsigned keys and duplicate keys.
+    BPlusTree<unsigned,int> unsigned_tree;
+    for (int i = 0; i < 1000; i++) {
+        unsigned_tree.insert(4000000000u, i);
+        unsigned_tree.insert((unsigned)i, i);
+    }
+    assert (unsigned_tree.tree_maximum() == 4000000000u);
+    assert (unsigned_tree.iterative_tree_search(4000000000u) == 0);
+    assert (unsigned_tree.iterative_tree_search(999) == 999);
+    assert (unsigned_tree.size() == 2000);
+
+    cout << "B+tree OK" << endl;
+
+    cout << "Testing compact LLRB" << endl;
+    cout << "Node size: " << CompactLLRB<int,int>::node_size() << " bytes" << endl;
+    assert ((CompactLLRB<int,int>::node_size() == 16));
+
+    CompactLLRB<int,string> my_compact_tree;
+    my_compact_tree.insert(3,"third");
+    my_compact_tree.insert(1,"first");
+    my_compact_tree.insert(5,"fifth");
+    my_compact_tree.insert(2,"second");
+    my_compact_tree.insert(4,"fourth");
+    actual = my_compact_tree.inorder_tree_walk();
+    assert (actual == expected);
+    assert (my_compact_tree.iterative_tree_search(4) == "fourth");
+    assert (my_compact_tree.iterative_tree_search(6) == "");
+
+    CompactLLRB<int,int> big_compact_tree;
+    big_compact_tree.reserve(array_size);
+    for (int i = 0; i < array_size; i++)
+        big_compact_tree.insert(keys[i], keys[i] * 2);
+    assert (big_compact_tree.size() == array_size);
+    assert (big_compact_tree.height() <= max_height);
+    assert (big_compact_tree.tree_minimum() == 0);
+    assert (big_compact_tree.tree_maximum() == array_size - 1);
+    for (int i = 0; i < array_size; i++)
+        assert (big_compact_tree.iterative_tree_search(i) == 2 * i);
+
+    // Random insertions and deletions, with duplicates, checked against a
+    // multiset. Deleted nodes are reused for the following insertions.
+    CompactLLRB<int,int,uint16_t> small_compact_tree;
+    multiset<int> compact_reference;
+    for (int round = 0; round < 20000; round++) {
+        int key = rand() % 500;
+        if (rand() % 2) {
+            small_compact_tree.insert(key, key);
+            compact_reference.insert(key);
+        }
+        else {
+            bool erased = small_compact_tree.erase(key);
+            multiset<int>::iterator ref = compact_reference.find(key);
+            assert (erased == (ref != compact_reference.end()));
+            if (erased)
+                compact_reference.erase(ref);
+        }
+    }
+    assert (small_compact_tree.size() == (long)compact_reference.size());
+    assert (small_compact_tree.height() <= 2*log2((double)(compact_reference.size()+1)));
+    multiset<int>::iterator compact_it = compact_reference.begin();
+    small_compact_tree.range_scan(0, 500, [&](int key, int) {
+        assert (key == *compact_it);
+        compact_it++;
+    });
+    assert (compact_it == compact_reference.end());
+    while (small_compact_tree.size() > 0)
+        small_compact_tree.erase(small_compact_tree.tree_minimum());
+    assert (small_compact_tree.height() == -1);
+
+    cout << "Compact LLRB OK" << endl;
+
+    cout << "Testing static index" << endl;
+
+    // A small index with duplicate keys, built from a BST.
+    BST<int,int> small_source;
+    for (int i = 0; i < 100; i++)
+        small_source.insert(i % 37, i);
+    StaticIndex<int,int> small_index(small_source);
+    assert (small_index.size() == 100);
+    assert (small_index.tree_minimum() == 0);
+    assert (small_index.tree_maximum() == 36);
+    assert (!small_index.contains(37));
+    assert (!small_index.contains(-1));
+    long small_count = 0;
+    int small_previous = -1;
+    small_index.range_scan(5, 10, [&](int key, int value) {
+        assert (key >= small_previous && key >= 5 && key <= 10);
+        assert (value % 37 == key);
+        small_previous = key;
+        small_count++;
+    });
+    assert (small_count == 18);
+
+    // Every size up to 300 so every shape of the last level is covered.
+    for (int n = 0; n < 300; n++) {
+        LLRB<int,int> source;
+        for (int i = 0; i < n; i++)
+            source.insert(2*i, i);
+        StaticIndex<int,int> index(source);
+        for (int i = 0; i < n; i++) {
+            assert (index.iterative_tree_search(2*i) == i);
+            assert (!index.contains(2*i + 1));
+        }
+        long count = 0;
+        index.range_scan(-1, 2*n, [&](int key, int) {
+            assert (key == 2*count);
+            count++;
+        });
+        assert (count == n);
+    }
+
+    // Lookups agree with the red-black tree it was built from.
+    RB<int,int> index_source;
+    for (int i = 0; i < array_size; i++)
+        index_source.insert(keys[i], keys[i]);
+    StaticIndex<int,int> big_index(index_source);
+    assert (big_index.size() == array_size);
+    for (int i = 0; i < array_size; i++)
+        assert (big_index.iterative_tree_search(keys[i]) ==
+                index_source.iterative_tree_search(keys[i]));
+
+    cout << "Static index OK" << endl;
+};
+
+void test_concurrent_trees() {
+    cout << "---- Testing concurrent trees ----" << endl;
+    cout << "Testing concurrent RB" << endl;
+
+    // The even keys stay in the tree the whole time. The writer keeps
+    // inserting and erasing the odd keys while the readers check that every
+    // even key is always found with the right value, and that range scans
+    // come out sorted.
+    const long stable_keys = 20000;
+    ConcurrentRB<long,string> tree;
+    for (long i = 0; i < stable_keys; i++)
+        tree.insert(2*i, to_string(2*i));
+    assert (tree.size() == stable_keys);
+
+    atomic<bool> done(false);
+    atomic<long> failures(0);
+    vector<thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.push_back(thread([&, t]() {
+            unsigned seed = t;
+            while (!done.load()) {
+                long key = 2 * (rand_r(&seed) % stable_keys);
+                string value;
+                if (!tree.find(key, value) || value != to_string(key))
+                    failures++;
+                string odd_value;
+                if (tree.find(key + 1, odd_value) && odd_value != to_string(key + 1))
+                    failures++;
+                long previous = key - 1;
+                long even_count = 0;
+                tree.range_scan(key, key + 200, [&](long k, const string & v) {
+                    if (k <= previous || v != to_string(k))
+                        failures++;
+                    if (k % 2 == 0)
+                        even_count++;
+                    previous = k;
+                });
+                if (even_count != min(101L, stable_keys - key / 2))
+                    failures++;
+            }
+        }));
+    }
+    for (int round = 0; round < 20; round++) {
+        for (long i = 0; i < stable_keys; i += 7)
+            tree.insert(2*i + 1, to_string(2*i + 1));
+        for (long i = 0; i < stable_keys; i += 7)
+            assert (tree.erase(2*i + 1));
+    }
+    done.store(true);
+    for (size_t t = 0; t < readers.size(); t++)
+        readers[t].join();
+    assert (failures.load() == 0);
+    assert (tree.size() == stable_keys);
+    assert (tree.iterative_tree_search(42) == "42");
+    assert (!tree.contains(43));
+
+    // Clearing waits for the readers that are in the tree, which must not
+    // wait for the writer in turn.
+    {
+        ConcurrentRB<long,string> cleared;
+        atomic<bool> stop(false);
+        vector<thread> workers;
+        for (int t = 0; t < 2; t++) {
+            workers.push_back(thread([&, t]() {
+                unsigned seed = t;
+                string value;
+                while (!stop.load())
+                    if (cleared.find(rand_r(&seed) % 1000, value) && value.empty())
+                        failures++;
+            }));
+        }
+        for (int round = 0; round < 20; round++) {
+            for (long i = 0; i < 1000; i++)
+                cleared.insert(i, to_string(i));
+            assert (cleared.size() == 1000);
+            cleared.clear();
+            assert (cleared.size() == 0);
+            assert (!cleared.contains(round));
+        }
+        stop.store(true);
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+        assert (failures.load() == 0);
+    }
+
+    cout << "Concurrent RB OK" << endl;
+
+    cout << "Testing persistent LLRB" << endl;
+
+    PersistentLLRB<int,string> persistent;
+    assert (persistent.size() == 0);
+    assert (persistent.height() == -1);
+    PersistentLLRB<int,string>::Snapshot empty = persistent.snapshot();
+    persistent.insert(3,"third");
+    persistent.insert(1,"first");
+    persistent.insert(5,"fifth");
+    PersistentLLRB<int,string>::Snapshot three = persistent.snapshot();
+    persistent.insert(2,"second");
+    persistent.insert(4,"fourth");
+    assert (empty.size() == 0);
+    assert (three.size() == 3);
+    assert (three.inorder_tree_walk() == "1: first\n3: third\n5: fifth\n");
+    assert (!three.contains(2));
+    assert (persistent.inorder_tree_walk() == "1: first\n2: second\n3: third\n4: fourth\n5: fifth\n");
+    assert (persistent.iterative_tree_search(4) == "fourth");
+
+    const int array_size = 100000;
+    double max_height = 2*log2((double)(array_size+1));
+    vector<long> keys(array_size);
+    for (int i = 0; i < array_size; i++)
+        keys[i] = i;
+    for (int i = array_size - 1; i > 0; i--)
+        swap(keys[i], keys[rand() % (i + 1)]);
+
+    // Take a snapshot every 1000 inserts and check that each one still sees
+    // exactly the keys that were in the tree when it was taken.
+    PersistentLLRB<long,long> versions;
+    vector<PersistentLLRB<long,long>::Snapshot> snapshots;
+    for (int i = 0; i < array_size; i++) {
+        if (i % 1000 == 0)
+            snapshots.push_back(versions.snapshot());
+        versions.insert(keys[i], i);
+    }
+    assert (versions.size() == array_size);
+    assert (versions.height() <= max_height);
+    for (size_t j = 0; j < snapshots.size(); j++) {
+        long n = j * 1000;
+        assert (snapshots[j].size() == n);
+        assert (snapshots[j].height() <= max_height);
+        for (long i = 0; i < array_size; i += 97) {
+            long value = -1;
+            bool found = snapshots[j].find(keys[i], value);
+            assert (found == (i < n));
+            assert (!found || value == i);
+        }
+        long previous = -1;
+        long count = 0;
+        snapshots[j].range_scan(0, array_size, [&](long k, long) {
+            assert (k > previous);
+            previous = k;
+            count++;
+        });
+        assert (count == n);
+    }
+    snapshots.clear();
+
+    // Readers take snapshots while the writer inserts, and check that every
+    // snapshot is whole: its keys are sorted and as many as its size.
+    PersistentLLRB<long,long> live;
+    atomic<bool> writing(true);
+    atomic<long> torn(0);
+    vector<thread> snapshot_readers;
+    for (int t = 0; t < 4; t++) {
+        snapshot_readers.push_back(thread([&]() {
+            while (writing.load()) {
+                PersistentLLRB<long,long>::Snapshot s = live.snapshot();
+                long previous = -1;
+                long count = 0;
+                s.range_scan(0, array_size, [&](long k, long v) {
+                    if (k <= previous || v != k)
+                        torn++;
+                    previous = k;
+                    count++;
+                });
+                if (count != s.size())
+                    torn++;
+            }
+        }));
+    }
+    for (int i = 0; i < array_size; i++)
+        live.insert(keys[i], keys[i]);
+    writing.store(false);
+    for (size_t t = 0; t < snapshot_readers.size(); t++)
+        snapshot_readers[t].join();
+    assert (torn.load() == 0);
+    assert (live.size() == array_size);
+    assert (live.tree_minimum() == 0);
+    assert (live.tree_maximum() == array_size - 1);
+
+    cout << "Persistent LLRB OK" << endl;
+};
+
+void test_concurrent_heaps() {
+    cout << "---- Testing concurrent heaps ----" << endl;
+    cout << "Testing MultiQueue" << endl;
+
+    // Four threads push and pop at the same time. Every value must come out
+    // exactly once.
+    MultiQueue<long> multi(4);
+    const long per_thread = 50000;
+    atomic<long> popped_sum(0);
+    atomic<long> popped_count(0);
+    vector<thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.push_back(thread([&, t]() {
+            long value;
+            for (long i = 0; i < per_thread; i++) {
+                multi.push(t * per_thread + i);
+                if (i % 2 == 0 && multi.try_pop(value)) {
+                    popped_sum += value;
+                    popped_count++;
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < 4; t++)
+        workers[t].join();
+    long value;
+    while (multi.try_pop(value)) {
+        popped_sum += value;
+        popped_count++;
+    }
+    assert (popped_count.load() == 4 * per_thread);
+    assert (popped_sum.load() == 4 * per_thread * (4 * per_thread - 1) / 2);
+    assert (multi.empty());
+
+    // Rank error: how many values in the queue were larger than the one
+    // that was popped. The remaining values are kept in a red-black tree to
+    // count them.
+    {
+        const long n = 100000;
+        MultiQueue<long> ranked(8);
+        RB<long,long> remaining;
+        vector<long> values(n);
+        for (long i = 0; i < n; i++)
+            values[i] = i;
+        for (long i = n - 1; i > 0; i--)
+            swap(values[i], values[rand() % (i + 1)]);
+        for (long i = 0; i < n; i++) {
+            ranked.push(values[i]);
+            remaining.insert(values[i], values[i]);
+        }
+        double total_error = 0;
+        long worst_error = 0;
+        while (ranked.try_pop(value)) {
+            long error = remaining.size() - remaining.rank(value);
+            total_error += error;
+            if (error > worst_error)
+                worst_error = error;
+            remaining.erase(value);
+        }
+        assert (remaining.size() == 0);
+        cout << "Rank error with 16 heaps, mean: " << total_error / n
+             << ", worst: " << worst_error << endl;
+    }
+
+    cout << "MultiQueue OK" << endl;
 };
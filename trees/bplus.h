@@ -0,0 +1,458 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _BPLUS_H_
+#define _BPLUS_H_
+
+#include <string>
+#include <sstream>
+#include <type_traits>
+#include "../util.h"
+#include "../pool.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Counts the keys among the first n keys that are greater than k, or greater
+// than or equal to k if inclusive is set. This is the plain version that
+// works for any key type. It has no early exit, so the compiler can turn it
+// into branch-free code.
+template<class TKey, int Size = sizeof(TKey),
+         bool Integral = std::is_integral<TKey>::value>
+struct KeyScan {
+    static int count_greater(const TKey * keys, int n, TKey k, bool inclusive) {
+        int count = 0;
+        if (inclusive) {
+            for (int i = 0; i < n; i++)
+                count += !(keys[i] < k);
+        }
+        else {
+            for (int i = 0; i < n; i++)
+                count += k < keys[i];
+        }
+        return count;
+    };
+};
+
+#if defined(__SSE2__)
+// Adds up the lanes of a vector of compare results. Every lane that compared
+// true is -1, so the counts are subtracted.
+template<class TLane>
+static inline int sum_lanes(__m128i acc) {
+    alignas(16) TLane lanes[16 / sizeof(TLane)];
+    _mm_store_si128((__m128i *)lanes, acc);
+    int count = 0;
+    for (unsigned i = 0; i < 16 / sizeof(TLane); i++)
+        count += (int)lanes[i];
+    return count;
+};
+
+// SIMD version for 32-bit integral keys.
+// Whole vectors are compared at a time and the rest of the keys are handled
+// by the generic version.
+template<class TKey>
+struct KeyScan<TKey, 4, true> {
+    static int count_greater(const TKey * keys, int n, TKey k, bool inclusive) {
+        // Unsigned keys are compared as signed after flipping the sign bit.
+        const int bias = std::is_signed<TKey>::value ? 0 : (int)0x80000000;
+        int i = 0;
+#if defined(__AVX2__)
+        const __m256i b = _mm256_set1_epi32(bias);
+        const __m256i v = _mm256_xor_si256(_mm256_set1_epi32((int)k), b);
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_xor_si256(
+                _mm256_load_si256((const __m256i *)(keys + i)), b);
+            __m256i gt = _mm256_cmpgt_epi32(x, v);
+            if (inclusive)
+                gt = _mm256_or_si256(gt, _mm256_cmpeq_epi32(x, v));
+            acc = _mm256_sub_epi32(acc, gt);
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                                    _mm256_extracti128_si256(acc, 1));
+#else
+        const __m128i b = _mm_set1_epi32(bias);
+        const __m128i v = _mm_xor_si128(_mm_set1_epi32((int)k), b);
+        __m128i sum = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_xor_si128(
+                _mm_load_si128((const __m128i *)(keys + i)), b);
+            __m128i gt = _mm_cmpgt_epi32(x, v);
+            if (inclusive)
+                gt = _mm_or_si128(gt, _mm_cmpeq_epi32(x, v));
+            sum = _mm_sub_epi32(sum, gt);
+        }
+#endif
+        return sum_lanes<int>(sum) +
+            KeyScan<TKey, 0, false>::count_greater(keys + i, n - i, k, inclusive);
+    };
+};
+#endif
+
+#if defined(__SSE4_2__)
+// SIMD version for 64-bit integral keys.
+// 64-bit compares need SSE4.2, so plain SSE2 builds use the generic version.
+template<class TKey>
+struct KeyScan<TKey, 8, true> {
+    static int count_greater(const TKey * keys, int n, TKey k, bool inclusive) {
+        const long long bias = std::is_signed<TKey>::value ? 0 :
+            (long long)0x8000000000000000ULL;
+        int i = 0;
+#if defined(__AVX2__)
+        const __m256i b = _mm256_set1_epi64x(bias);
+        const __m256i v = _mm256_xor_si256(_mm256_set1_epi64x((long long)k), b);
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_xor_si256(
+                _mm256_load_si256((const __m256i *)(keys + i)), b);
+            __m256i gt = _mm256_cmpgt_epi64(x, v);
+            if (inclusive)
+                gt = _mm256_or_si256(gt, _mm256_cmpeq_epi64(x, v));
+            acc = _mm256_sub_epi64(acc, gt);
+        }
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc),
+                                    _mm256_extracti128_si256(acc, 1));
+#else
+        const __m128i b = _mm_set1_epi64x(bias);
+        const __m128i v = _mm_xor_si128(_mm_set1_epi64x((long long)k), b);
+        __m128i sum = _mm_setzero_si128();
+        for (; i + 2 <= n; i += 2) {
+            __m128i x = _mm_xor_si128(
+                _mm_load_si128((const __m128i *)(keys + i)), b);
+            __m128i gt = _mm_cmpgt_epi64(x, v);
+            if (inclusive)
+                gt = _mm_or_si128(gt, _mm_cmpeq_epi64(x, v));
+            sum = _mm_sub_epi64(sum, gt);
+        }
+#endif
+        return sum_lanes<long long>(sum) +
+            KeyScan<TKey, 0, false>::count_greater(keys + i, n - i, k, inclusive);
+    };
+};
+#endif
+
+/**
+ * Implementation of a B+tree.
+ *
+ * All keys and values live in the leaves, which are linked together in key
+ * order. Inner nodes only hold separator keys. The key array of a node is
+ * four cache lines long and aligned to a cache line, and for integral keys
+ * the position of a key within a node is found with SIMD compares instead of
+ * a comparison per key.
+ *
+ * Has the same interface as Tree, but is not a Tree since the nodes are not
+ * binary.
+ */
+template<class TKey, class TValue>
+class BPlusTree {
+    private:
+        // The number of keys in a node. The key array is 256 bytes, but
+        // never fewer than four keys.
+        static const int capacity = sizeof(TKey) * 4 > 256 ? 4 :
+            256 / (int)sizeof(TKey);
+
+        struct Node {
+            alignas(64) TKey keys[capacity];
+            int count;
+            bool leaf;
+            Node(bool leaf) : keys(), count(0), leaf(leaf) {};
+        };
+
+        struct InnerNode : Node {
+            Node * children[capacity+1];
+            InnerNode() : Node(false) {};
+        };
+
+        struct LeafNode : Node {
+            TValue values[capacity];
+            LeafNode * prev;
+            LeafNode * next;
+            LeafNode() : Node(true), prev(NULL), next(NULL) {};
+        };
+
+        Node * root = NULL;
+        LeafNode * first = NULL;
+        LeafNode * last = NULL;
+        long count = 0;
+        int levels = 0;
+
+        NodePool<InnerNode> innerPool;
+        NodePool<LeafNode> leafPool;
+
+        // Returns the number of keys in x that are at most k, which is also
+        // the child to follow when inserting k.
+        static int upper_position(Node * x, TKey k) {
+            return x->count - KeyScan<TKey>::count_greater(x->keys, x->count, k, false);
+        };
+
+        // Returns the number of keys in x that are less than k.
+        static int lower_position(Node * x, TKey k) {
+            return x->count - KeyScan<TKey>::count_greater(x->keys, x->count, k, true);
+        };
+
+        // Finds the leaf and the position in it of the first key that is not
+        // less than k. The position can be one past the last key of the
+        // leaf, in which case the key, if any, is at the start of the next
+        // leaf.
+        LeafNode * lower_bound(TKey k, int & i) {
+            Node * x = this->root;
+            while (!x->leaf)
+                x = static_cast<InnerNode *>(x)->children[lower_position(x, k)];
+            LeafNode * leaf = static_cast<LeafNode *>(x);
+            i = lower_position(leaf, k);
+            if (i == leaf->count && leaf->next) {
+                leaf = leaf->next;
+                i = 0;
+            }
+            return leaf;
+        };
+
+        // Inserts the key and value into the subtree of x.
+        // If x had to be split, the new right sibling is returned and its
+        // smallest key is put in separator. Otherwise NULL is returned.
+        Node * insert(Node * x, TKey key, TValue value, TKey & separator) {
+            if (x->leaf) {
+                LeafNode * leaf = static_cast<LeafNode *>(x);
+                int i = upper_position(leaf, key);
+                if (leaf->count < capacity) {
+                    insert_into_leaf(leaf, i, key, value);
+                    return NULL;
+                }
+                LeafNode * right = split_leaf(leaf);
+                if (i <= leaf->count)
+                    insert_into_leaf(leaf, i, key, value);
+                else
+                    insert_into_leaf(right, i - leaf->count, key, value);
+                separator = right->keys[0];
+                return right;
+            }
+
+            InnerNode * inner = static_cast<InnerNode *>(x);
+            int i = upper_position(inner, key);
+            TKey childSeparator;
+            Node * child = insert(inner->children[i], key, value, childSeparator);
+            if (!child)
+                return NULL;
+            if (inner->count < capacity) {
+                insert_into_inner(inner, i, childSeparator, child);
+                return NULL;
+            }
+
+            // The middle key moves up, the keys after it go to the new node.
+            InnerNode * right = this->innerPool.create();
+            int middle = capacity / 2;
+            separator = inner->keys[middle];
+            for (int j = middle + 1; j < capacity; j++)
+                right->keys[j - middle - 1] = inner->keys[j];
+            for (int j = middle + 1; j <= capacity; j++)
+                right->children[j - middle - 1] = inner->children[j];
+            right->count = capacity - middle - 1;
+            inner->count = middle;
+            if (i <= middle)
+                insert_into_inner(inner, i, childSeparator, child);
+            else
+                insert_into_inner(right, i - middle - 1, childSeparator, child);
+            return right;
+        };
+
+        void insert_into_leaf(LeafNode * leaf, int i, TKey key, TValue value) {
+            for (int j = leaf->count; j > i; j--) {
+                leaf->keys[j] = leaf->keys[j-1];
+                leaf->values[j] = leaf->values[j-1];
+            }
+            leaf->keys[i] = key;
+            leaf->values[i] = value;
+            leaf->count++;
+        };
+
+        // Puts the key at position i and the child to the right of it.
+        void insert_into_inner(InnerNode * inner, int i, TKey key, Node * child) {
+            for (int j = inner->count; j > i; j--) {
+                inner->keys[j] = inner->keys[j-1];
+                inner->children[j+1] = inner->children[j];
+            }
+            inner->keys[i] = key;
+            inner->children[i+1] = child;
+            inner->count++;
+        };
+
+        // Moves the upper half of a full leaf to a new leaf linked after it.
+        LeafNode * split_leaf(LeafNode * leaf) {
+            LeafNode * right = this->leafPool.create();
+            int middle = capacity / 2;
+            for (int j = middle; j < capacity; j++) {
+                right->keys[j - middle] = leaf->keys[j];
+                right->values[j - middle] = leaf->values[j];
+            }
+            right->count = capacity - middle;
+            leaf->count = middle;
+            right->prev = leaf;
+            right->next = leaf->next;
+            if (leaf->next)
+                leaf->next->prev = right;
+            else
+                this->last = right;
+            leaf->next = right;
+            return right;
+        };
+
+        void destroy_subtree(Node * x) {
+            if (x->leaf) {
+                this->leafPool.destroy(static_cast<LeafNode *>(x));
+            }
+            else {
+                InnerNode * inner = static_cast<InnerNode *>(x);
+                for (int i = 0; i <= inner->count; i++)
+                    destroy_subtree(inner->children[i]);
+                this->innerPool.destroy(inner);
+            }
+        };
+
+    public:
+        BPlusTree() {};
+
+        BPlusTree(const BPlusTree &) = delete;
+        BPlusTree & operator=(const BPlusTree &) = delete;
+
+        ~BPlusTree() {
+            clear();
+        };
+
+        // Puts a new key and value into the tree. Equal keys are kept in the
+        // order they were inserted.
+        // Logarithmic time, O(log n).
+        void insert(TKey key, TValue value) {
+            if (!this->root) {
+                this->first = this->last = this->leafPool.create();
+                this->root = this->first;
+                this->levels = 1;
+            }
+            TKey separator;
+            Node * right = insert(this->root, key, value, separator);
+            if (right) {
+                // The root was split, so the tree grows by one level.
+                InnerNode * newRoot = this->innerPool.create();
+                newRoot->keys[0] = separator;
+                newRoot->children[0] = this->root;
+                newRoot->children[1] = right;
+                newRoot->count = 1;
+                this->root = newRoot;
+                this->levels++;
+            }
+            this->count++;
+        };
+
+        // Searches for a specific key.
+        // Returns the value of the first match, or a default value if the key
+        // is not in the tree.
+        // Logarithmic time, O(log n).
+        TValue iterative_tree_search(TKey k) {
+            if (!this->root)
+                return TValue();
+            int i;
+            LeafNode * leaf = lower_bound(k, i);
+            if (i < leaf->count && leaf->keys[i] == k)
+                return leaf->values[i];
+            return TValue();
+        };
+
+        // Returns true if the key is in the tree.
+        bool contains(TKey k) {
+            if (!this->root)
+                return false;
+            int i;
+            LeafNode * leaf = lower_bound(k, i);
+            return i < leaf->count && leaf->keys[i] == k;
+        };
+
+        // Calls visit(key, value) for every key in [lo, hi], in order.
+        // The scan follows the links between the leaves.
+        template<class TVisitor>
+        void range_scan(TKey lo, TKey hi, TVisitor visit) {
+            if (!this->root)
+                return;
+            int i;
+            LeafNode * leaf = lower_bound(lo, i);
+            for (; leaf; leaf = leaf->next, i = 0) {
+                for (; i < leaf->count; i++) {
+                    if (hi < leaf->keys[i])
+                        return;
+                    visit(leaf->keys[i], leaf->values[i]);
+                }
+            }
+        };
+
+        // Prints all keys and values in order.
+        // Linear time, O(n).
+        std::string inorder_tree_walk() {
+            std::ostringstream os;
+            for (LeafNode * leaf = this->first; leaf; leaf = leaf->next) {
+                for (int i = 0; i < leaf->count; i++)
+                    os << to_string(leaf->keys[i]) + ": " + to_string(leaf->values[i]) << std::endl;
+            }
+            return os.str();
+        };
+
+        // Find the minimum key in the tree.
+        // Constant time, O(1).
+        TKey tree_minimum() {
+            return this->first->keys[0];
+        };
+
+        // Find the maximum key in the tree.
+        // Constant time, O(1).
+        TKey tree_maximum() {
+            return this->last->keys[this->last->count-1];
+        };
+
+        // Returns the height of the tree, counted in nodes like Tree does:
+        // -1 for an empty tree and 0 for a tree with a single leaf.
+        // Constant time, O(1).
+        int height() {
+            return this->levels - 1;
+        };
+
+        // Returns the number of keys in the tree.
+        long size() {
+            return this->count;
+        };
+
+        // Removes all keys from the tree.
+        void clear() {
+            if (this->root) {
+                if (std::is_trivially_destructible<TKey>::value &&
+                    std::is_trivially_destructible<TValue>::value) {
+                    this->innerPool.clear();
+                    this->leafPool.clear();
+                }
+                else
+                    destroy_subtree(this->root);
+            }
+            this->root = NULL;
+            this->first = this->last = NULL;
+            this->count = 0;
+            this->levels = 0;
+        };
+};
+
+#endif
@@ -40,7 +40,7 @@ class BST: public Tree<TKey, TValue> {
         // tree is h, this operation is O(h).
         // Adapted from Cormen et. al., section 12.3
         void insert(TKey key, TValue value) {
-            TreeNode * z = new TreeNode(key, value);
+            TreeNode * z = this->create_node(key, value);
             TreeNode * y, * x;
             y = NULL;
             x = this->root;
@@ -58,6 +58,7 @@ class BST: public Tree<TKey, TValue> {
                 y->left = z;
             else
                 y->right = z;
+            this->update_path(y);
         };
 };
 
@@ -0,0 +1,399 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _COMPACT_LLRB_H_
+#define _COMPACT_LLRB_H_
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include "tree.h"
+
+/**
+ * A left-leaning red-black tree with small nodes.
+ *
+ * The nodes live in one array and point at each other with array indices of
+ * type TIndex instead of pointers. The color is kept in the lowest bit of
+ * the left link, and there is no parent link, so with the default 32-bit
+ * indices a node costs 8 bytes on top of its key and value. A Tree<int,int>
+ * node needs 48.
+ *
+ * Index 0 is the empty link. Removed nodes are kept on a free list and used
+ * again by the next insertion. A tree can hold up to 2^31 - 1 nodes with
+ * 32-bit indices; use a 64-bit TIndex for more.
+ *
+ * Uses the same 2-3 insertion and deletion as LLRB, but a removed node gets
+ * the key and value of its successor copied into it, since nothing points
+ * at nodes from outside the tree.
+ */
+template<class TKey, class TValue, class TIndex = uint32_t>
+class CompactLLRB {
+    static_assert(std::is_unsigned<TIndex>::value,
+                  "CompactLLRB needs an unsigned index type");
+
+    private:
+        struct Node {
+            TKey key;
+            TValue value;
+            TIndex leftColor;
+            TIndex right;
+        };
+
+        static const TIndex nil = 0;
+        static const TIndex maxNodes = (TIndex)~(TIndex)0 >> 1;
+
+        // nodes[0] is never used, so that index 0 can be the empty link.
+        std::vector<Node> nodes;
+        TIndex root = nil;
+        TIndex freeList = nil;
+        long count = 0;
+
+        TIndex left(TIndex x) const {
+            return this->nodes[x].leftColor >> 1;
+        };
+
+        TIndex right(TIndex x) const {
+            return this->nodes[x].right;
+        };
+
+        void set_left(TIndex x, TIndex y) {
+            this->nodes[x].leftColor = (TIndex)(y << 1) | (this->nodes[x].leftColor & 1);
+        };
+
+        void set_right(TIndex x, TIndex y) {
+            this->nodes[x].right = y;
+        };
+
+        bool color(TIndex x) const {
+            return this->nodes[x].leftColor & 1;
+        };
+
+        void set_color(TIndex x, bool c) {
+            this->nodes[x].leftColor = (this->nodes[x].leftColor & ~(TIndex)1) | (TIndex)c;
+        };
+
+        bool is_red(TIndex x) const {
+            return x != nil && color(x) == RED;
+        };
+
+        TIndex create_node(TKey key, TValue value) {
+            TIndex x;
+            if (this->freeList != nil) {
+                x = this->freeList;
+                this->freeList = right(x);
+            }
+            else {
+                if (this->nodes.size() > maxNodes)
+                    throw std::length_error("CompactLLRB index type is too small");
+                x = (TIndex)this->nodes.size();
+                this->nodes.push_back(Node());
+            }
+            Node & n = this->nodes[x];
+            n.key = key;
+            n.value = value;
+            n.leftColor = RED;
+            n.right = nil;
+            this->count++;
+            return x;
+        };
+
+        void destroy_node(TIndex x) {
+            this->nodes[x].key = TKey();
+            this->nodes[x].value = TValue();
+            set_right(x, this->freeList);
+            this->freeList = x;
+            this->count--;
+        };
+
+        // The recursive functions below take and return indices rather than
+        // references to nodes, since an insertion can move the array.
+
+        TIndex insert(TIndex h, TKey key, TValue value) {
+            if (h == nil)
+                return create_node(key, value);
+
+            if (key < this->nodes[h].key) {
+                TIndex x = insert(left(h), key, value);
+                set_left(h, x);
+            }
+            else {
+                TIndex x = insert(right(h), key, value);
+                set_right(h, x);
+            }
+
+            return fix_up(h);
+        };
+
+        // Returns true if h is the last node with the key k in its subtree.
+        // The nodes after h are all in its right subtree, so h is the last
+        // one unless the smallest key there is also k.
+        bool is_last(TIndex h, TKey k) const {
+            if (this->nodes[h].key != k)
+                return false;
+            TIndex x = right(h);
+            if (x == nil)
+                return true;
+            while (left(x) != nil)
+                x = left(x);
+            return this->nodes[x].key != k;
+        };
+
+        // Removes the last node with the key k from the subtree of h, which
+        // must contain one. Removing the last one rather than the first one
+        // that is met keeps the search going right past equal keys, which is
+        // the direction the deletion expects.
+        // Adapted from Sedgewick, Left-leaning Red-Black Trees
+        TIndex erase(TIndex h, TKey k) {
+            if (k < this->nodes[h].key) {
+                if (!is_red(left(h)) && !is_red(left(left(h))))
+                    h = move_red_left(h);
+                set_left(h, erase(left(h), k));
+            }
+            else {
+                if (is_red(left(h)))
+                    h = rotate_right(h);
+                if (right(h) == nil && this->nodes[h].key == k) {
+                    destroy_node(h);
+                    return nil;
+                }
+                if (!is_red(right(h)) && !is_red(left(right(h))))
+                    h = move_red_right(h);
+                if (is_last(h, k)) {
+                    TIndex m = right(h);
+                    while (left(m) != nil)
+                        m = left(m);
+                    this->nodes[h].key = this->nodes[m].key;
+                    this->nodes[h].value = this->nodes[m].value;
+                    set_right(h, erase_min(right(h)));
+                }
+                else
+                    set_right(h, erase(right(h), k));
+            }
+            return fix_up(h);
+        };
+
+        TIndex erase_min(TIndex h) {
+            if (left(h) == nil) {
+                destroy_node(h);
+                return nil;
+            }
+            if (!is_red(left(h)) && !is_red(left(left(h))))
+                h = move_red_left(h);
+            set_left(h, erase_min(left(h)));
+            return fix_up(h);
+        };
+
+        TIndex move_red_left(TIndex h) {
+            color_flip(h);
+            if (is_red(left(right(h)))) {
+                set_right(h, rotate_right(right(h)));
+                h = rotate_left(h);
+                color_flip(h);
+            }
+            return h;
+        };
+
+        TIndex move_red_right(TIndex h) {
+            color_flip(h);
+            if (is_red(left(left(h)))) {
+                h = rotate_right(h);
+                color_flip(h);
+            }
+            return h;
+        };
+
+        TIndex fix_up(TIndex h) {
+            if (is_red(right(h)) && !is_red(left(h)))
+                h = rotate_left(h);
+            if (is_red(left(h)) && is_red(left(left(h))))
+                h = rotate_right(h);
+            if (is_red(left(h)) && is_red(right(h)))
+                color_flip(h);
+            return h;
+        };
+
+        TIndex rotate_left(TIndex h) {
+            TIndex x = right(h);
+            set_right(h, left(x));
+            set_left(x, h);
+            set_color(x, color(h));
+            set_color(h, RED);
+            return x;
+        };
+
+        TIndex rotate_right(TIndex h) {
+            TIndex x = left(h);
+            set_left(h, right(x));
+            set_right(x, h);
+            set_color(x, color(h));
+            set_color(h, RED);
+            return x;
+        };
+
+        void color_flip(TIndex h) {
+            set_color(h, !color(h));
+            set_color(left(h), !color(left(h)));
+            set_color(right(h), !color(right(h)));
+        };
+
+        int height(TIndex x) const {
+            if (x == nil)
+                return -1;
+            return std::max(height(left(x)), height(right(x))) + 1;
+        };
+
+        void inorder_tree_walk(TIndex x, std::ostringstream & os) const {
+            if (x != nil) {
+                inorder_tree_walk(left(x), os);
+                os << this->nodes[x].key << ": " << this->nodes[x].value << std::endl;
+                inorder_tree_walk(right(x), os);
+            }
+        };
+
+        template<class TVisitor>
+        void range_scan(TIndex x, TKey lo, TKey hi, TVisitor & visit) const {
+            if (x == nil)
+                return;
+            const Node & n = this->nodes[x];
+            if (!(n.key < lo))
+                range_scan(left(x), lo, hi, visit);
+            if (!(n.key < lo) && !(hi < n.key))
+                visit(n.key, n.value);
+            if (!(hi < n.key))
+                range_scan(right(x), lo, hi, visit);
+        };
+
+        TIndex search(TKey k) const {
+            TIndex x = this->root;
+            while (x != nil && this->nodes[x].key != k) {
+                if (k < this->nodes[x].key)
+                    x = left(x);
+                else
+                    x = right(x);
+            }
+            return x;
+        };
+
+    public:
+        CompactLLRB() : nodes(1) {};
+
+        // Returns the number of bytes a node takes in the array.
+        static size_t node_size() {
+            return sizeof(Node);
+        };
+
+        void insert(TKey key, TValue value) {
+            this->root = insert(this->root, key, value);
+            set_color(this->root, BLACK);
+        };
+
+        // Removes a node with the key k. Returns false if there is none.
+        // Logarithmic time, O(log n), unless k is in the tree many times.
+        bool erase(TKey k) {
+            if (search(k) == nil)
+                return false;
+            if (!is_red(left(this->root)) && !is_red(right(this->root)))
+                set_color(this->root, RED);
+            this->root = erase(this->root, k);
+            if (this->root != nil)
+                set_color(this->root, BLACK);
+            return true;
+        };
+
+        // Searches for the key k. If it is found, its value is copied to
+        // value and true is returned.
+        // Logarithmic time, O(log n).
+        bool find(TKey k, TValue & value) const {
+            TIndex x = search(k);
+            if (x != nil)
+                value = this->nodes[x].value;
+            return x != nil;
+        };
+
+        bool contains(TKey k) const {
+            return search(k) != nil;
+        };
+
+        // Returns the value of the key k, or a default value if k is not in
+        // the tree.
+        TValue iterative_tree_search(TKey k) const {
+            TIndex x = search(k);
+            return x != nil ? this->nodes[x].value : TValue();
+        };
+
+        TKey tree_minimum() const {
+            TIndex x = this->root;
+            while (left(x) != nil)
+                x = left(x);
+            return this->nodes[x].key;
+        };
+
+        TKey tree_maximum() const {
+            TIndex x = this->root;
+            while (right(x) != nil)
+                x = right(x);
+            return this->nodes[x].key;
+        };
+
+        // Linear time, O(n).
+        int height() const {
+            return height(this->root);
+        };
+
+        long size() const {
+            return this->count;
+        };
+
+        // Makes room for n nodes in total, so the array is not moved while
+        // the tree grows to that size.
+        void reserve(long n) {
+            this->nodes.reserve(n + 1);
+        };
+
+        // Removes all nodes and gives the array back.
+        void clear() {
+            std::vector<Node>(1).swap(this->nodes);
+            this->root = nil;
+            this->freeList = nil;
+            this->count = 0;
+        };
+
+        // Prints all nodes in order.
+        // Linear time, O(n).
+        std::string inorder_tree_walk() const {
+            std::ostringstream os;
+            inorder_tree_walk(this->root, os);
+            return os.str();
+        };
+
+        // Calls visit(key, value) for every key in [lo, hi], in order.
+        template<class TVisitor>
+        void range_scan(TKey lo, TKey hi, TVisitor visit) const {
+            range_scan(this->root, lo, hi, visit);
+        };
+};
+
+#endif
@@ -0,0 +1,288 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _CONCURRENT_RB_H_
+#define _CONCURRENT_RB_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <type_traits>
+#include "rb.h"
+#include "../epoch.h"
+
+/**
+ * A red-black tree that can be searched by many threads while one thread at
+ * a time changes it.
+ *
+ * Writers take a lock and run the normal RB insertion and deletion. Around
+ * every change they bump a sequence number, which is odd while the tree is
+ * being changed. Readers take no locks. They remember the sequence number,
+ * walk the tree and check that the number did not change. If it did, the
+ * walk may have seen a half-rotated tree, so they walk again.
+ *
+ * Removed nodes are not reused until every reader that might still be
+ * looking at them is gone, which is tracked with an Epoch. Keys and values
+ * are never changed while a node is in the tree, so a value that is copied
+ * out after a successful check is always whole.
+ *
+ * Keys are compared while the tree may be changing, so they must be
+ * trivially copyable, like integers.
+ */
+template<class TKey, class TValue>
+class ConcurrentRB: protected RB<TKey, TValue> {
+    static_assert(std::is_trivially_copyable<TKey>::value,
+                  "ConcurrentRB needs trivially copyable keys");
+
+    private:
+        typedef typename Tree<TKey,TValue>::TreeNode TreeNode;
+
+        // Removed nodes are freed in batches of this size.
+        static const size_t retireBatch = 64;
+
+        // No walk in a valid red-black tree is longer than this. A longer
+        // walk means the tree changed under the reader.
+        static const int maxSteps = 128;
+
+        std::mutex writer;
+        std::atomic<unsigned long> sequence;
+        Epoch epoch;
+        std::vector<TreeNode *> retired;
+        // The number of nodes, kept apart from the sizes in the nodes so
+        // readers never look at those.
+        std::atomic<long> count;
+
+        // Reads a link that the writer may be changing. Pairs with
+        // Tree::set_link, so the key and value of the node are visible.
+        static TreeNode * read(TreeNode * const & p) {
+            return __atomic_load_n(&p, __ATOMIC_ACQUIRE);
+        };
+
+        void begin_write() {
+            this->sequence.store(this->sequence.load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        };
+
+        void end_write() {
+            this->sequence.store(this->sequence.load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_release);
+        };
+
+        // Waits until no writer is busy and returns the sequence number.
+        unsigned long begin_read() {
+            unsigned long s;
+            while ((s = this->sequence.load(std::memory_order_acquire)) & 1)
+                std::this_thread::yield();
+            return s;
+        };
+
+        // Returns true if no writer changed the tree since begin_read().
+        bool validate(unsigned long s) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return this->sequence.load(std::memory_order_relaxed) == s;
+        };
+
+        // Frees the retired nodes once no reader can see them anymore.
+        // Must be called with the writer lock held.
+        void reclaim() {
+            this->epoch.synchronize();
+            for (size_t i = 0; i < this->retired.size(); i++)
+                this->destroy_node(this->retired[i]);
+            this->retired.clear();
+        };
+
+        // Finds the first node with a key not less than k, or greater than k
+        // if inclusive is false. Returns false if the walk went on for too
+        // long, which can only happen if the tree changed.
+        bool seek(TKey k, bool inclusive, TreeNode * & result) {
+            TreeNode * x = read(this->root);
+            TreeNode * y = NULL;
+            for (int steps = 0; x; steps++) {
+                if (steps == maxSteps)
+                    return false;
+                if (x->key < k || (!inclusive && !(k < x->key)))
+                    x = read(x->right);
+                else {
+                    y = x;
+                    x = read(x->left);
+                }
+            }
+            result = y;
+            return true;
+        };
+
+        // Same as Tree::successor, with bounded steps.
+        bool next(TreeNode * x, TreeNode * & result) {
+            int steps = 0;
+            TreeNode * y = read(x->right);
+            if (y) {
+                TreeNode * z;
+                while ((z = read(y->left))) {
+                    if (++steps == maxSteps)
+                        return false;
+                    y = z;
+                }
+                result = y;
+                return true;
+            }
+            y = read(x->parent);
+            while (y && x == read(y->right)) {
+                if (++steps == maxSteps)
+                    return false;
+                x = y;
+                y = read(y->parent);
+            }
+            result = y;
+            return true;
+        };
+
+    public:
+        ConcurrentRB() : sequence(0), count(0) {};
+
+        ~ConcurrentRB() {
+            clear();
+        };
+
+        // Puts a new node into the tree.
+        // Takes the writer lock. Logarithmic time, O(log n).
+        void insert(TKey key, TValue value) {
+            std::lock_guard<std::mutex> lock(this->writer);
+            begin_write();
+            RB<TKey,TValue>::insert(key, value);
+            end_write();
+            this->count.store(this->count.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+        };
+
+        // Removes a node with the key k. Returns false if there is none.
+        // Takes the writer lock. Logarithmic time, O(log n).
+        bool erase(TKey k) {
+            std::lock_guard<std::mutex> lock(this->writer);
+            TreeNode * z = this->node_of(Tree<TKey,TValue>::find(k));
+            if (!z)
+                return false;
+            begin_write();
+            this->remove_node(z);
+            end_write();
+            this->count.store(this->count.load(std::memory_order_relaxed) - 1,
+                              std::memory_order_relaxed);
+            this->retired.push_back(z);
+            if (this->retired.size() >= retireBatch)
+                reclaim();
+            return true;
+        };
+
+        // Removes all nodes. Waits for the readers that are in the tree.
+        // Linear time, O(n), unless the keys and values need no destructor.
+        void clear() {
+            std::lock_guard<std::mutex> lock(this->writer);
+            // Readers that start after the root is detached see an empty
+            // tree, and the ones that are still in the old tree are waited
+            // for before any of its nodes are freed.
+            begin_write();
+            TreeNode * x = this->root;
+            this->set_link(this->root, NULL);
+            end_write();
+            this->count.store(0, std::memory_order_relaxed);
+            reclaim();
+            this->destroy_subtree(x);
+            this->pool.clear();
+        };
+
+        // Searches for the key k without taking any locks. If it is found,
+        // its value is copied to value and true is returned.
+        // Logarithmic time, O(log n), unless writers keep interfering.
+        bool find(TKey k, TValue & value) {
+            Epoch::Guard guard(this->epoch);
+            for (;;) {
+                unsigned long s = begin_read();
+                TreeNode * x = read(this->root);
+                int steps = 0;
+                while (x && x->key != k && steps < maxSteps) {
+                    if (k < x->key)
+                        x = read(x->left);
+                    else
+                        x = read(x->right);
+                    steps++;
+                }
+                if (!validate(s) || steps == maxSteps)
+                    continue;
+                if (x)
+                    value = x->value;
+                return x != NULL;
+            }
+        };
+
+        // Returns true if the key k is in the tree. Takes no locks.
+        bool contains(TKey k) {
+            TValue value;
+            return find(k, value);
+        };
+
+        // Searches for the key k without taking any locks.
+        // Returns the value, or a default value if k is not in the tree.
+        TValue iterative_tree_search(TKey k) {
+            TValue value = TValue();
+            find(k, value);
+            return value;
+        };
+
+        // Returns the number of nodes in the tree. Takes no locks.
+        // Constant time, O(1).
+        long size() {
+            return this->count.load(std::memory_order_relaxed);
+        };
+
+        // Calls visit(key, value) for every node with a key in [lo, hi], in
+        // order, without taking any locks. Every node is checked before it
+        // is visited. If a writer gets in the way, the scan picks up after
+        // the last key it visited, so keys come out in increasing order and
+        // at most once. A key that is in the tree twice can be visited only
+        // once if a writer interrupts the scan between the two.
+        template<class TVisitor>
+        void range_scan(TKey lo, TKey hi, TVisitor visit) {
+            Epoch::Guard guard(this->epoch);
+            TKey from = lo;
+            bool inclusive = true;
+            for (;;) {
+                unsigned long s = begin_read();
+                TreeNode * x;
+                if (!seek(from, inclusive, x) || !validate(s))
+                    continue;
+                bool interrupted = false;
+                while (x && !(hi < x->key)) {
+                    visit(x->key, x->value);
+                    from = x->key;
+                    inclusive = false;
+                    if (!next(x, x) || !validate(s)) {
+                        interrupted = true;
+                        break;
+                    }
+                }
+                if (!interrupted)
+                    return;
+            }
+        };
+};
+
+#endif
@@ -27,18 +27,52 @@
 
 /**
  * Implementation of a balanced left-leaning red-black tree.
+ *
+ * This is the 2-3 variant from Sedgewick, where 4-nodes are split on the way
+ * up after an insertion. The deletion below relies on the tree being a 2-3
+ * tree.
  */
 template<class TKey, class TValue>
 class LLRB: public Tree<TKey, TValue> {
     public:
+        typedef typename Tree<TKey,TValue>::iterator iterator;
+
         void insert(TKey key, TValue value) {
-            // If the root does not exist, create it.
-            // Otherwise insert recursively at the root.
-            TreeNode * x = new TreeNode(key, value);
-            if (!(this->root))
-                this->root = x;
-            else
-                this->root = insert(this->root, key, value);
+            // Insert recursively at the root. The root is always black.
+            this->root = insert(this->root, key, value);
+            this->root->color = BLACK;
+            this->root->parent = NULL;
+        }
+
+        // Puts a new node at the end of the tree. The key must not be less
+        // than any key already in the tree, which is the case when the keys
+        // come in increasing order. No keys are compared on the way down.
+        // Logarithmic time, O(log n).
+        void append(TKey key, TValue value) {
+            this->root = append(this->root, key, value);
+            this->root->color = BLACK;
+            this->root->parent = NULL;
+        }
+
+        // Removes a node with the key k and gives it back to the pool.
+        // Returns false if there is no such node.
+        // Logarithmic time, O(log n).
+        bool erase(TKey k) {
+            TreeNode * z = this->node_of(this->find(k));
+            if (!z)
+                return false;
+            erase_position(this->position(z));
+            return true;
+        }
+
+        // Removes the node at the given position and returns an iterator to
+        // the node after it. Iterators to other nodes stay valid.
+        // Logarithmic time, O(log n).
+        iterator erase(iterator it) {
+            TreeNode * z = this->node_of(it);
+            TreeNode * next = this->successor(z);
+            erase_position(this->position(z));
+            return this->make_iterator(next);
         }
 
     private:
@@ -48,40 +82,152 @@ class LLRB: public Tree<TKey, TValue> {
         TreeNode * insert(TreeNode * h, TKey key, TValue value) {
             // Bottom of the recursion -- return a new node.
             if (!h) {
-                TreeNode * x = new TreeNode(key, value, RED);
-                return x;
+                return this->create_node(key, value, RED);
             }
 
-            // If both left and right child color is RED then perform a color
-            // flip.
-            if (h->left && h->left->color == RED && 
-                h->right && h->right->color == RED)
-                color_flip(h);
-
             // Go down the left subtree.
             if (key < h->key)
                 h->left = insert(h->left, key, value);
             else
                 h->right = insert(h->right, key, value);
 
-            if (h->right && h->right->color == RED)
+            return fix_up(h);
+        };
+
+        // Same as insert, but always goes down the right subtree.
+        TreeNode * append(TreeNode * h, TKey key, TValue value) {
+            if (!h)
+                return this->create_node(key, value, RED);
+
+            h->right = append(h->right, key, value);
+
+            return fix_up(h);
+        };
+
+        // Removes the node at position p, counting from 1.
+        // The nodes are found by their position rather than their key, so
+        // the right node is removed even when several nodes have the same key.
+        void erase_position(long p) {
+            if (!this->is_red(this->root->left) && !this->is_red(this->root->right))
+                this->root->color = RED;
+            this->root = erase(this->root, p);
+            if (this->root) {
+                this->root->color = BLACK;
+                this->root->parent = NULL;
+            }
+        };
+
+        // Removes the node at position p in the subtree of h. On the way down
+        // red links are pushed along so the node that is removed at the
+        // bottom is never a 2-node.
+        // Adapted from Sedgewick, Left-leaning Red-Black Trees
+        TreeNode * erase(TreeNode * h, long p) {
+            if (p <= this->size(h->left)) {
+                if (!this->is_red(h->left) && !this->is_red(h->left->left))
+                    h = move_red_left(h);
+                h->left = erase(h->left, p);
+            }
+            else {
+                if (this->is_red(h->left))
+                    h = rotate_right(h);
+                if (p == this->size(h->left) + 1 && !h->right) {
+                    this->destroy_node(h);
+                    return NULL;
+                }
+                if (!this->is_red(h->right) && !this->is_red(h->right->left))
+                    h = move_red_right(h);
+                long r = this->size(h->left) + 1;
+                if (p == r) {
+                    // Put the smallest node of the right subtree in the place
+                    // of h instead of copying its key and value into h.
+                    TreeNode * m;
+                    TreeNode * right = erase_min(h->right, m);
+                    m->left = h->left;
+                    m->right = right;
+                    m->color = h->color;
+                    m->parent = h->parent;
+                    this->destroy_node(h);
+                    h = m;
+                }
+                else
+                    h->right = erase(h->right, p - r);
+            }
+            return fix_up(h);
+        };
+
+        // Unlinks the smallest node in the subtree of h and puts it in m.
+        // Adapted from Sedgewick, Left-leaning Red-Black Trees
+        TreeNode * erase_min(TreeNode * h, TreeNode * & m) {
+            if (!h->left) {
+                m = h;
+                return NULL;
+            }
+            if (!this->is_red(h->left) && !this->is_red(h->left->left))
+                h = move_red_left(h);
+            h->left = erase_min(h->left, m);
+            return fix_up(h);
+        };
+
+        // Makes h->left or one of its children red.
+        TreeNode * move_red_left(TreeNode * h) {
+            color_flip(h);
+            if (this->is_red(h->right->left)) {
+                h->right = rotate_right(h->right);
+                h = rotate_left(h);
+                color_flip(h);
+            }
+            return h;
+        };
+
+        // Makes h->right or one of its children red.
+        TreeNode * move_red_right(TreeNode * h) {
+            color_flip(h);
+            if (this->is_red(h->left->left)) {
+                h = rotate_right(h);
+                color_flip(h);
+            }
+            return h;
+        };
+
+        // Restores the left-leaning property on the way up after an
+        // insertion or deletion in the subtree of h, and splits 4-nodes.
+        // Also points the children of h back at h, since they may have been
+        // replaced on the way down.
+        TreeNode * fix_up(TreeNode * h) {
+            if (h->left)
+                h->left->parent = h;
+            if (h->right)
+                h->right->parent = h;
+
+            if (this->is_red(h->right) && !this->is_red(h->left))
                 h = rotate_left(h);
 
-            if (h->left->color == RED && 
-                h->left->left && h->left->left->color == RED)
+            if (this->is_red(h->left) && this->is_red(h->left->left))
                 h = rotate_right(h);
 
+            if (this->is_red(h->left) && this->is_red(h->right))
+                color_flip(h);
+
+            this->update(h);
             return h;
         };
 
-        // Left rotates the subtree rooted at h
+        // Left rotates the subtree rooted at h.
+        // The parent pointers are kept up to date for the iterators, but it
+        // is up to the caller to point the parent of h at the new root.
         TreeNode * rotate_left(TreeNode * h) {
             TreeNode * x;
             x = h->right;
             h->right = x->left;
+            if (h->right)
+                h->right->parent = h;
             x->left = h;
+            x->parent = h->parent;
+            h->parent = x;
             x->color = x->left->color;
             x->left->color = RED;
+            this->update(h);
+            this->update(x);
             return x;
         };
 
@@ -90,9 +236,15 @@ class LLRB: public Tree<TKey, TValue> {
             TreeNode * x;
             x = h->left;
             h->left = x->right;
+            if (h->left)
+                h->left->parent = h;
             x->right = h;
+            x->parent = h->parent;
+            h->parent = x;
             x->color = x->right->color;
             x->right->color = RED;
+            this->update(h);
+            this->update(x);
             return x;
         };
 
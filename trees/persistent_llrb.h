@@ -0,0 +1,356 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _PERSISTENT_LLRB_H_
+#define _PERSISTENT_LLRB_H_
+
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include "tree.h"
+
+/**
+ * A persistent left-leaning red-black tree.
+ *
+ * snapshot() returns an immutable version of the tree in constant time.
+ * Later insertions do not change the snapshot: an insertion copies only the
+ * nodes on its path that are shared with a snapshot, and links the copies to
+ * the untouched subtrees, which are then shared by both versions. When no
+ * snapshot is alive, nothing is shared and insertions change the nodes in
+ * place, just like LLRB.
+ *
+ * A node counts the links that point to it, from parents, snapshots and the
+ * tree itself, and is freed when the last one goes away. Snapshots can be
+ * taken, read and dropped on any thread while one thread inserts.
+ *
+ * Uses the same 2-3 insertion as LLRB. The nodes have no parent pointers,
+ * since a shared node can have many parents.
+ */
+template<class TKey, class TValue>
+class PersistentLLRB {
+    private:
+        struct Node {
+            TKey key;
+            TValue value;
+            bool color;
+            int height;
+            long size;
+            Node * left;
+            Node * right;
+            std::atomic<long> links;
+
+            Node(TKey key, TValue value, bool color) : key(key), value(value),
+                color(color), height(0), size(1), left(NULL), right(NULL),
+                links(1) {};
+
+            // A copy of x with its own link, sharing the children of x.
+            Node(const Node & x) : key(x.key), value(x.value), color(x.color),
+                height(x.height), size(x.size), left(x.left), right(x.right),
+                links(1) {
+                retain(left);
+                retain(right);
+            };
+        };
+
+        Node * root = NULL;
+        std::mutex writer;
+
+        static void retain(Node * x) {
+            if (x)
+                x->links.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        // Drops a link to x and frees x if it was the last one.
+        static void release(Node * x) {
+            if (x && x->links.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                release(x->left);
+                release(x->right);
+                delete x;
+            }
+        };
+
+        static bool is_red(Node * x) {
+            return x && x->color == RED;
+        };
+
+        // Makes sure the node in the given link is not shared, so it can be
+        // changed. A shared node is replaced by a copy of it.
+        static void own(Node * & x) {
+            if (x && x->links.load(std::memory_order_acquire) > 1) {
+                Node * y = new Node(*x);
+                release(x);
+                x = y;
+            }
+        };
+
+        static void update(Node * x) {
+            x->size = (x->left ? x->left->size : 0) + (x->right ? x->right->size : 0) + 1;
+            x->height = std::max(x->left ? x->left->height : -1,
+                                 x->right ? x->right->height : -1) + 1;
+        };
+
+        // Inserts into the subtree of h, which must not be shared.
+        static Node * insert(Node * h, TKey key, TValue value) {
+            if (!h)
+                return new Node(key, value, RED);
+
+            if (key < h->key) {
+                own(h->left);
+                h->left = insert(h->left, key, value);
+            }
+            else {
+                own(h->right);
+                h->right = insert(h->right, key, value);
+            }
+
+            return fix_up(h);
+        };
+
+        static Node * fix_up(Node * h) {
+            if (is_red(h->right) && !is_red(h->left))
+                h = rotate_left(h);
+            if (is_red(h->left) && is_red(h->left->left))
+                h = rotate_right(h);
+            if (is_red(h->left) && is_red(h->right))
+                color_flip(h);
+            update(h);
+            return h;
+        };
+
+        // The rotations and the color flip change the children of h, so they
+        // take their own copies of them first if they are shared.
+        static Node * rotate_left(Node * h) {
+            own(h->right);
+            Node * x = h->right;
+            h->right = x->left;
+            x->left = h;
+            x->color = h->color;
+            h->color = RED;
+            update(h);
+            update(x);
+            return x;
+        };
+
+        static Node * rotate_right(Node * h) {
+            own(h->left);
+            Node * x = h->left;
+            h->left = x->right;
+            x->right = h;
+            x->color = h->color;
+            h->color = RED;
+            update(h);
+            update(x);
+            return x;
+        };
+
+        static void color_flip(Node * h) {
+            own(h->left);
+            own(h->right);
+            h->color = !h->color;
+            h->left->color = !h->left->color;
+            h->right->color = !h->right->color;
+        };
+
+    public:
+        /**
+         * An immutable version of the tree. Cheap to copy.
+         */
+        class Snapshot {
+            friend class PersistentLLRB;
+            private:
+                Node * root;
+
+                static void inorder_tree_walk(Node * x, std::ostringstream & os) {
+                    if (x) {
+                        inorder_tree_walk(x->left, os);
+                        os << x->key << ": " << x->value << std::endl;
+                        inorder_tree_walk(x->right, os);
+                    }
+                };
+
+                template<class TVisitor>
+                static void range_scan(Node * x, TKey lo, TKey hi, TVisitor & visit) {
+                    if (!x)
+                        return;
+                    if (!(x->key < lo))
+                        range_scan(x->left, lo, hi, visit);
+                    if (!(x->key < lo) && !(hi < x->key))
+                        visit(x->key, x->value);
+                    if (!(hi < x->key))
+                        range_scan(x->right, lo, hi, visit);
+                };
+
+            public:
+                Snapshot() : root(NULL) {};
+
+                Snapshot(const Snapshot & other) : root(other.root) {
+                    retain(root);
+                };
+
+                Snapshot & operator=(const Snapshot & other) {
+                    retain(other.root);
+                    release(this->root);
+                    this->root = other.root;
+                    return *this;
+                };
+
+                ~Snapshot() {
+                    release(this->root);
+                };
+
+                // Searches for the key k. If it is found, its value is copied
+                // to value and true is returned.
+                // Logarithmic time, O(log n).
+                bool find(TKey k, TValue & value) {
+                    Node * x = this->root;
+                    while (x && x->key != k) {
+                        if (k < x->key)
+                            x = x->left;
+                        else
+                            x = x->right;
+                    }
+                    if (x)
+                        value = x->value;
+                    return x != NULL;
+                };
+
+                // Returns the value of the key k, or a default value if k is
+                // not in this version.
+                TValue iterative_tree_search(TKey k) {
+                    TValue value = TValue();
+                    find(k, value);
+                    return value;
+                };
+
+                bool contains(TKey k) {
+                    TValue value;
+                    return find(k, value);
+                };
+
+                TKey tree_minimum() {
+                    Node * x = this->root;
+                    while (x->left)
+                        x = x->left;
+                    return x->key;
+                };
+
+                TKey tree_maximum() {
+                    Node * x = this->root;
+                    while (x->right)
+                        x = x->right;
+                    return x->key;
+                };
+
+                // Constant time, O(1).
+                int height() {
+                    return this->root ? this->root->height : -1;
+                };
+
+                // Constant time, O(1).
+                long size() {
+                    return this->root ? this->root->size : 0;
+                };
+
+                // Prints all nodes in order.
+                // Linear time, O(n).
+                std::string inorder_tree_walk() {
+                    std::ostringstream os;
+                    inorder_tree_walk(this->root, os);
+                    return os.str();
+                };
+
+                // Calls visit(key, value) for every key in [lo, hi], in order.
+                template<class TVisitor>
+                void range_scan(TKey lo, TKey hi, TVisitor visit) {
+                    range_scan(this->root, lo, hi, visit);
+                };
+        };
+
+        PersistentLLRB() {};
+
+        PersistentLLRB(const PersistentLLRB &) = delete;
+        PersistentLLRB & operator=(const PersistentLLRB &) = delete;
+
+        ~PersistentLLRB() {
+            release(this->root);
+        };
+
+        // Puts a new node into the tree. Snapshots that were taken before are
+        // not affected. Only one thread may insert at a time.
+        // Logarithmic time, O(log n), and O(log n) new nodes if the tree
+        // shares nodes with a snapshot.
+        void insert(TKey key, TValue value) {
+            std::lock_guard<std::mutex> lock(this->writer);
+            own(this->root);
+            this->root = insert(this->root, key, value);
+            this->root->color = BLACK;
+        };
+
+        // Returns the current version of the tree.
+        // Constant time, O(1).
+        Snapshot snapshot() {
+            std::lock_guard<std::mutex> lock(this->writer);
+            Snapshot s;
+            s.root = this->root;
+            retain(s.root);
+            return s;
+        };
+
+        // The read operations below work on the current version.
+
+        TValue iterative_tree_search(TKey k) {
+            return snapshot().iterative_tree_search(k);
+        };
+
+        bool contains(TKey k) {
+            return snapshot().contains(k);
+        };
+
+        TKey tree_minimum() {
+            return snapshot().tree_minimum();
+        };
+
+        TKey tree_maximum() {
+            return snapshot().tree_maximum();
+        };
+
+        int height() {
+            return snapshot().height();
+        };
+
+        long size() {
+            return snapshot().size();
+        };
+
+        std::string inorder_tree_walk() {
+            return snapshot().inorder_tree_walk();
+        };
+
+        template<class TVisitor>
+        void range_scan(TKey lo, TKey hi, TVisitor visit) {
+            snapshot().range_scan(lo, hi, visit);
+        };
+};
+
+#endif
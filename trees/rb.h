@@ -31,10 +31,12 @@
 template<class TKey, class TValue>
 class RB: public Tree<TKey, TValue> {
     public:
+        typedef typename Tree<TKey,TValue>::iterator iterator;
+
         // Red-black insertion function.
         // Adapted from Cormen, section 13.3
         void insert(TKey key, TValue value) {
-            TreeNode * z = new TreeNode(key, value);
+            TreeNode * z = this->create_node(key, value);
             TreeNode * y, * x;
             y = NULL;
             x = this->root;
@@ -45,22 +47,199 @@ class RB: public Tree<TKey, TValue> {
                 else
                     x = x->right;
             }
-            z->parent = y;
+            this->set_link(z->parent, y);
             if (!y) {
-                this->root = z;
+                this->set_link(this->root, z);
             }
             else if (z->key < y->key)
-                y->left = z;
+                this->set_link(y->left, z);
             else
-                y->right = z;
+                this->set_link(y->right, z);
             z->color = RED;
+            this->update_path(y);
             insert_fixup(z);
+            this->update_path(z);
         }
 
-    private:
+        // Puts a new node at the end of the tree. The key must not be less
+        // than any key already in the tree, which is the case when the keys
+        // come in increasing order. The new node is hung below the maximum
+        // without comparing any keys, and then the tree is fixed up as usual.
+        // Logarithmic time, O(log n), with an amortized constant number of
+        // rotations.
+        void append(TKey key, TValue value) {
+            TreeNode * z = this->create_node(key, value, RED);
+            TreeNode * y = this->root;
+            if (!y) {
+                this->set_link(this->root, z);
+            }
+            else {
+                while (y->right)
+                    y = y->right;
+                this->set_link(z->parent, y);
+                this->set_link(y->right, z);
+                this->update_path(y);
+            }
+            insert_fixup(z);
+            this->update_path(z);
+        }
+
+        // Removes a node with the key k and gives it back to the pool.
+        // Returns false if there is no such node.
+        // Logarithmic time, O(log n).
+        bool erase(TKey k) {
+            TreeNode * z = this->node_of(this->find(k));
+            if (!z)
+                return false;
+            remove_node(z);
+            this->destroy_node(z);
+            return true;
+        }
+
+        // Removes the node at the given position and returns an iterator to
+        // the node after it. Iterators to other nodes stay valid.
+        // Logarithmic time, O(log n).
+        iterator erase(iterator it) {
+            TreeNode * z = this->node_of(it);
+            TreeNode * next = this->successor(z);
+            remove_node(z);
+            this->destroy_node(z);
+            return this->make_iterator(next);
+        }
+
+    protected:
         // typedef the TreeNode so it is available in methods.
         typedef typename Tree<TKey,TValue>::TreeNode TreeNode;
 
+        // Unlinks the node z from the tree without destroying it.
+        // Nodes are moved around rather than having their keys and values
+        // copied, so no other node changes contents.
+        // Adapted from Cormen, section 13.4
+        void remove_node(TreeNode * z) {
+            TreeNode * y = z;
+            TreeNode * x, * xParent;
+            bool yColor = y->color;
+            if (!z->left) {
+                x = z->right;
+                xParent = z->parent;
+                transplant(z, z->right);
+            }
+            else if (!z->right) {
+                x = z->left;
+                xParent = z->parent;
+                transplant(z, z->left);
+            }
+            else {
+                y = this->minimum(z->right);
+                yColor = y->color;
+                x = y->right;
+                if (y->parent == z) {
+                    xParent = y;
+                }
+                else {
+                    xParent = y->parent;
+                    transplant(y, y->right);
+                    this->set_link(y->right, z->right);
+                    this->set_link(y->right->parent, y);
+                }
+                transplant(z, y);
+                this->set_link(y->left, z->left);
+                this->set_link(y->left->parent, y);
+                y->color = z->color;
+            }
+            this->set_link(z->left, NULL);
+            this->set_link(z->right, NULL);
+            this->set_link(z->parent, NULL);
+
+            // All nodes that lost a descendant are on the path up from
+            // xParent. Their sizes must be right before the fixup rotates
+            // them, and the rotations leave the nodes above them to be fixed.
+            this->update_path(xParent);
+            if (yColor == BLACK)
+                delete_fixup(x, xParent);
+            this->update_path(xParent);
+        };
+
+    private:
+        // Replaces the subtree of u with the subtree of v.
+        // Adapted from Cormen, section 13.4
+        void transplant(TreeNode * u, TreeNode * v) {
+            if (!(u->parent))
+                this->set_link(this->root, v);
+            else if (u == u->parent->left)
+                this->set_link(u->parent->left, v);
+            else
+                this->set_link(u->parent->right, v);
+            if (v)
+                this->set_link(v->parent, u->parent);
+        };
+
+        // Red-black deletion fixup.
+        // Since the leaves are NULL and not a sentinel, the parent of x is
+        // passed along, as x can be NULL.
+        // Adapted from Cormen, section 13.4
+        void delete_fixup(TreeNode * x, TreeNode * xParent) {
+            TreeNode * w;
+            while (x != this->root && !this->is_red(x)) {
+                if (x == xParent->left) {
+                    w = xParent->right;
+                    if (this->is_red(w)) {
+                        w->color = BLACK;
+                        xParent->color = RED;
+                        rotate_left(xParent);
+                        w = xParent->right;
+                    }
+                    if (!this->is_red(w->left) && !this->is_red(w->right)) {
+                        w->color = RED;
+                        x = xParent;
+                        xParent = x->parent;
+                    }
+                    else {
+                        if (!this->is_red(w->right)) {
+                            w->left->color = BLACK;
+                            w->color = RED;
+                            rotate_right(w);
+                            w = xParent->right;
+                        }
+                        w->color = xParent->color;
+                        xParent->color = BLACK;
+                        w->right->color = BLACK;
+                        rotate_left(xParent);
+                        x = this->root;
+                    }
+                }
+                else {
+                    w = xParent->left;
+                    if (this->is_red(w)) {
+                        w->color = BLACK;
+                        xParent->color = RED;
+                        rotate_right(xParent);
+                        w = xParent->left;
+                    }
+                    if (!this->is_red(w->right) && !this->is_red(w->left)) {
+                        w->color = RED;
+                        x = xParent;
+                        xParent = x->parent;
+                    }
+                    else {
+                        if (!this->is_red(w->left)) {
+                            w->right->color = BLACK;
+                            w->color = RED;
+                            rotate_left(w);
+                            w = xParent->left;
+                        }
+                        w->color = xParent->color;
+                        xParent->color = BLACK;
+                        w->left->color = BLACK;
+                        rotate_right(xParent);
+                        x = this->root;
+                    }
+                }
+            }
+            if (x)
+                x->color = BLACK;
+        };
+
         // Red-black insertion fixup.
         // Maintains the red-black tree property.
         // Adapted from Cormen, section 13.3
@@ -112,18 +291,20 @@ class RB: public Tree<TKey, TValue> {
         void rotate_left(TreeNode * x) {
             TreeNode * y;
             y = x->right;
-            x->right = y->left;
+            this->set_link(x->right, y->left);
             if (y->left)
-                y->left->parent = x;
-            y->parent = x->parent;
+                this->set_link(y->left->parent, x);
+            this->set_link(y->parent, x->parent);
             if (!(x->parent))
-                this->root = y;
+                this->set_link(this->root, y);
             else if (x == x->parent->left)
-                x->parent->left = y;
+                this->set_link(x->parent->left, y);
             else
-                x->parent->right = y;
-            y->left = x;
-            x->parent = y;		
+                this->set_link(x->parent->right, y);
+            this->set_link(y->left, x);
+            this->set_link(x->parent, y);
+            this->update(x);
+            this->update(y);
         };
 
         // Right-rotates the subtree rooted at y.
@@ -133,18 +314,20 @@ class RB: public Tree<TKey, TValue> {
         void rotate_right(TreeNode * y) {
             TreeNode * x;
             x = y->left;
-            y->left = x->right;
+            this->set_link(y->left, x->right);
             if (x->right)
-                x->right->parent = y;
-            x->parent = y->parent;
+                this->set_link(x->right->parent, y);
+            this->set_link(x->parent, y->parent);
             if (!(y->parent))
-                this->root = x;
+                this->set_link(this->root, x);
             else if (y == y->parent->left)
-                y->parent->left = x;
+                this->set_link(y->parent->left, x);
             else
-                y->parent->right = x;
-            x->right = y;
-            y->parent = x;
+                this->set_link(y->parent->right, x);
+            this->set_link(x->right, y);
+            this->set_link(y->parent, x);
+            this->update(y);
+            this->update(x);
         };
 };
 
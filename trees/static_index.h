@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2014 David Volquartz Lebech
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _STATIC_INDEX_H_
+#define _STATIC_INDEX_H_
+
+#include <new>
+#include <utility>
+#include "tree.h"
+
+/**
+ * A read-only copy of a tree, laid out for fast searching.
+ *
+ * The keys are stored in one array in Eytzinger order: the root is at index
+ * 1 and the children of the node at index k are at 2k and 2k+1, like in a
+ * heap. A search looks at one key per level without any branches that
+ * depend on the keys, and fetches the cache line it will need a few levels
+ * further down while it works on the current one. The values are kept in a
+ * separate array so the keys are packed as tightly as possible.
+ *
+ * It is built from a BST, RB or LLRB tree in linear time and does not change
+ * afterwards.
+ */
+template<class TKey, class TValue>
+class StaticIndex {
+    private:
+        // The number of keys in a cache line. The descendants of index i
+        // that are log2(keysPerLine) levels down start at i * keysPerLine
+        // and share one cache line.
+        static const long keysPerLine = 64 / sizeof(TKey) > 0 ? 64 / sizeof(TKey) : 1;
+
+        TKey * keys = NULL;
+        TValue * values = NULL;
+        long n = 0;
+
+        // Copies the nodes of the tree into the subtree of index k, in order.
+        template<class TIterator>
+        void fill(TIterator & it, long k) {
+            if (k <= this->n) {
+                fill(it, 2*k);
+                new (&this->keys[k]) TKey(it->key);
+                new (&this->values[k]) TValue(it->value);
+                ++it;
+                fill(it, 2*k + 1);
+            }
+        };
+
+        // Returns the index of the first key that is not less than k, or 0.
+        long lower_bound(TKey k) const {
+            long i = 1;
+            while (i <= this->n) {
+                // Nothing is read from the prefetched address, so it does not
+                // matter that it can be past the end of the array.
+                __builtin_prefetch(this->keys + i * keysPerLine);
+                i = 2*i + (this->keys[i] < k);
+            }
+            // Going left at the last node means the answer is that node. Undo
+            // the trailing right turns, and the left turn, to get to it.
+            return i >> __builtin_ffsl(~i);
+        };
+
+        // Returns the index that comes after i in order, or 0.
+        // Amortized constant time, O(1).
+        long successor(long i) const {
+            if (2*i + 1 <= this->n) {
+                i = 2*i + 1;
+                while (2*i <= this->n)
+                    i = 2*i;
+                return i;
+            }
+            return i >> __builtin_ffsl(~i);
+        };
+
+        void release() {
+            for (long i = 1; i <= this->n; i++) {
+                this->keys[i].~TKey();
+                this->values[i].~TValue();
+            }
+            if (this->keys) {
+                ::operator delete(this->keys, std::align_val_t(64));
+                ::operator delete(this->values, std::align_val_t(64));
+            }
+            this->keys = NULL;
+            this->values = NULL;
+            this->n = 0;
+        };
+
+    public:
+        StaticIndex() {};
+
+        // Builds the index from the nodes of tree.
+        // Linear time, O(n).
+        StaticIndex(Tree<TKey, TValue> & tree) {
+            this->n = tree.size();
+            // Index 0 is not used, so that the children of index k are at 2k
+            // and 2k+1.
+            this->keys = static_cast<TKey *>(::operator new(
+                (this->n + 1) * sizeof(TKey), std::align_val_t(64)));
+            this->values = static_cast<TValue *>(::operator new(
+                (this->n + 1) * sizeof(TValue), std::align_val_t(64)));
+            typename Tree<TKey, TValue>::iterator it = tree.begin();
+            fill(it, 1);
+        };
+
+        StaticIndex(const StaticIndex &) = delete;
+        StaticIndex & operator=(const StaticIndex &) = delete;
+
+        StaticIndex(StaticIndex && other) {
+            std::swap(this->keys, other.keys);
+            std::swap(this->values, other.values);
+            std::swap(this->n, other.n);
+        };
+
+        StaticIndex & operator=(StaticIndex && other) {
+            std::swap(this->keys, other.keys);
+            std::swap(this->values, other.values);
+            std::swap(this->n, other.n);
+            return *this;
+        };
+
+        ~StaticIndex() {
+            release();
+        };
+
+        // Searches for the key k. If it is found, its value is copied to
+        // value and true is returned.
+        // Logarithmic time, O(log n).
+        bool find(TKey k, TValue & value) const {
+            long i = lower_bound(k);
+            if (i == 0 || k < this->keys[i])
+                return false;
+            value = this->values[i];
+            return true;
+        };
+
+        bool contains(TKey k) const {
+            long i = lower_bound(k);
+            return i != 0 && !(k < this->keys[i]);
+        };
+
+        // Returns the value of the key k, or a default value if k is not in
+        // the index.
+        TValue iterative_tree_search(TKey k) const {
+            long i = lower_bound(k);
+            if (i == 0 || k < this->keys[i])
+                return TValue();
+            return this->values[i];
+        };
+
+        TKey tree_minimum() const {
+            long i = 1;
+            while (2*i <= this->n)
+                i = 2*i;
+            return this->keys[i];
+        };
+
+        TKey tree_maximum() const {
+            long i = 1;
+            while (2*i + 1 <= this->n)
+                i = 2*i + 1;
+            return this->keys[i];
+        };
+
+        long size() const {
+            return this->n;
+        };
+
+        // Calls visit(key, value) for every key in [lo, hi], in order.
+        // If m keys are visited, this operation is O(log n + m).
+        template<class TVisitor>
+        void range_scan(TKey lo, TKey hi, TVisitor visit) const {
+            for (long i = lower_bound(lo); i != 0 && !(hi < this->keys[i]);
+                 i = successor(i))
+                visit(this->keys[i], this->values[i]);
+        };
+};
+
+#endif
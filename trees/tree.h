@@ -26,7 +26,12 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <type_traits>
+#include <iterator>
+#include <utility>
+#include <cstddef>
 #include "../util.h"
+#include "../pool.h"
 
 const bool RED = true;
 const bool BLACK = false;
@@ -40,16 +45,24 @@ class Tree {
             TKey key;
             TValue value;
             bool color;
+            // The height of the subtree rooted here. A leaf has height 0.
+            int height;
+            // The number of nodes in the subtree rooted here.
+            long size;
             TreeNode * left;
             TreeNode * right;
             TreeNode * parent;
             TreeNode() {
+                height = 0;
+                size = 1;
                 left = NULL;
                 right = NULL;
                 parent = NULL;
                 color = BLACK;
             };
             TreeNode(TKey key, TValue value) {
+                height = 0;
+                size = 1;
                 left = NULL;
                 right = NULL;
                 parent = NULL;
@@ -58,6 +71,8 @@ class Tree {
                 this->value = value;
             };
             TreeNode(TKey key, TValue value, bool color) {
+                height = 0;
+                size = 1;
                 left = NULL;
                 right = NULL;
                 parent = NULL;
@@ -69,9 +84,364 @@ class Tree {
 
         TreeNode * root = NULL;
 
+        // All nodes of the tree are allocated from this pool.
+        NodePool<TreeNode> pool;
+
+        // Allocates a new node from the pool.
+        TreeNode * create_node(TKey key, TValue value, bool color = BLACK) {
+            return this->pool.create(key, value, color);
+        };
+
+        // Gives the node x back to the pool so it can be reused.
+        void destroy_node(TreeNode * x) {
+            this->pool.destroy(x);
+        };
+
+        // Points the link p at x. The store is atomic, so a thread that
+        // walks the tree while it is changed, as in ConcurrentRB, sees
+        // either the old or the new node, and a new node with its key and
+        // value already in place.
+        static void set_link(TreeNode * & p, TreeNode * x) {
+            __atomic_store_n(&p, x, __ATOMIC_RELEASE);
+        };
+
+        // Returns true if x is a red node. Empty subtrees are black.
+        static bool is_red(TreeNode * x) {
+            return x && x->color == RED;
+        };
+
+        // Returns the number of nodes in the subtree of x.
+        static long size(TreeNode * x) {
+            return x ? x->size : 0;
+        };
+
+        // Recomputes the size and height of x from its children.
+        // Every operation that changes the children of a node must call this
+        // on the node afterwards, bottom-up.
+        // Adapted from Cormen et. al., section 14.1
+        static void update(TreeNode * x) {
+            x->size = size(x->left) + size(x->right) + 1;
+            x->height = std::max(x->left ? x->left->height : -1,
+                                 x->right ? x->right->height : -1) + 1;
+        };
+
+        // Recomputes the size and height of x and all of its ancestors.
+        static void update_path(TreeNode * x) {
+            while (x) {
+                update(x);
+                x = x->parent;
+            }
+        };
+
+        // Runs the destructor of every node in the subtree of x, without
+        // giving the memory back to the pool. Does nothing if the keys and
+        // values need no destructor. Linear time, O(n), otherwise.
+        static void destroy_subtree(TreeNode * x) {
+            if (std::is_trivially_destructible<TreeNode>::value)
+                return;
+            // Destroy the nodes without recursion by rotating every left
+            // child up until the current node has none.
+            while (x) {
+                if (x->left) {
+                    TreeNode * y = x->left;
+                    x->left = y->right;
+                    y->right = x;
+                    x = y;
+                }
+                else {
+                    TreeNode * y = x->right;
+                    x->~TreeNode();
+                    x = y;
+                }
+            }
+        };
+
+        // Makes a copy of the subtree of x, with y as the parent of the copy.
+        TreeNode * copy_subtree(TreeNode * x, TreeNode * y) {
+            if (!x)
+                return NULL;
+            TreeNode * z = create_node(x->key, x->value, x->color);
+            z->parent = y;
+            z->left = copy_subtree(x->left, z);
+            z->right = copy_subtree(x->right, z);
+            update(z);
+            return z;
+        };
+
+        // Builds a balanced subtree out of the next n nodes handed out by
+        // next(), which must come in sorted order. The subtree is built as
+        // a 2-3 tree with the given number of levels, where a 3-node is a
+        // black node with a red left child. Such a tree is both a valid
+        // red-black tree and a valid left-leaning red-black tree.
+        // A 2-3 tree with l levels holds between 2^l - 1 and 3^l - 1 keys.
+        // Linear time, O(n).
+        template<class TNext>
+        TreeNode * build_subtree(TNext & next, long n, int levels, TreeNode * parent) {
+            if (levels == 0)
+                return NULL;
+
+            // The most keys a subtree one level down can hold, 3^(l-1) - 1.
+            // It is capped at n so it does not overflow.
+            long most = 1;
+            for (int i = 1; i < levels && most <= n; i++)
+                most *= 3;
+            most--;
+
+            TreeNode * left, * x;
+            if (n - 1 <= 2 * most) {
+                // A 2-node. The keys are split as evenly as possible.
+                long leftCount = (n - 1) - (n - 1) / 2;
+                left = build_subtree(next, leftCount, levels - 1, NULL);
+                x = next();
+                x->color = BLACK;
+                x->left = left;
+                x->right = build_subtree(next, n - 1 - leftCount, levels - 1, x);
+            }
+            else {
+                // A 3-node, which needs two keys and three subtrees.
+                long childCount[3];
+                for (int i = 0; i < 3; i++)
+                    childCount[i] = (n - 2) / 3 + (i < (n - 2) % 3 ? 1 : 0);
+                TreeNode * y;
+                left = build_subtree(next, childCount[0], levels - 1, NULL);
+                y = next();
+                y->color = RED;
+                y->left = left;
+                if (left)
+                    left->parent = y;
+                y->right = build_subtree(next, childCount[1], levels - 1, y);
+                update(y);
+                x = next();
+                x->color = BLACK;
+                x->left = y;
+                left = y;
+                x->right = build_subtree(next, childCount[2], levels - 1, x);
+            }
+            if (left)
+                left->parent = x;
+            x->parent = parent;
+            update(x);
+            return x;
+        };
+
+        // Builds a balanced tree out of the next n nodes handed out by next(),
+        // replacing the current contents of the tree.
+        template<class TNext>
+        void build_tree(TNext next, long n) {
+            clear();
+            this->pool.reserve(n);
+            int levels = 0;
+            while ((2L << levels) - 1 <= n)
+                levels++;
+            this->root = build_subtree(next, n, levels, NULL);
+        };
+
+        // Returns the node with the smallest key in the subtree of x.
+        // Adapted from Cormen et. al., section 12.2
+        static TreeNode * minimum(TreeNode * x) {
+            while (x->left)
+                x = x->left;
+            return x;
+        };
+
+        // Returns the node with the largest key in the subtree of x.
+        // Adapted from Cormen et. al., section 12.2
+        static TreeNode * maximum(TreeNode * x) {
+            while (x->right)
+                x = x->right;
+            return x;
+        };
+
+        // Returns the node that comes after x in order, or NULL if x is the
+        // last node. Uses the parent pointers, so no stack is needed.
+        // Adapted from Cormen et. al., section 12.2
+        static TreeNode * successor(TreeNode * x) {
+            if (x->right)
+                return minimum(x->right);
+            TreeNode * y = x->parent;
+            while (y && x == y->right) {
+                x = y;
+                y = y->parent;
+            }
+            return y;
+        };
+
+        // Returns the node that comes before x in order, or NULL if x is the
+        // first node.
+        static TreeNode * predecessor(TreeNode * x) {
+            if (x->left)
+                return maximum(x->left);
+            TreeNode * y = x->parent;
+            while (y && x == y->left) {
+                x = y;
+                y = y->parent;
+            }
+            return y;
+        };
+
+        // Returns the position of x in order, counting from 1.
+        // If the height of the tree is h, this operation is O(h).
+        // Adapted from Cormen et. al., section 14.1
+        static long position(TreeNode * x) {
+            long r = size(x->left) + 1;
+            for (TreeNode * y = x; y->parent; y = y->parent) {
+                if (y == y->parent->right)
+                    r += size(y->parent->left) + 1;
+            }
+            return r;
+        };
+
     public:
+        // A bidirectional iterator over the nodes of the tree in order.
+        // Dereferencing it gives the node, so the key and value are available
+        // as it->key and it->value. The key must not be changed.
+        class iterator {
+            friend class Tree;
+            private:
+                TreeNode * node;
+                Tree * tree;
+
+                iterator(TreeNode * node, Tree * tree) {
+                    this->node = node;
+                    this->tree = tree;
+                };
+
+            public:
+                typedef std::bidirectional_iterator_tag iterator_category;
+                typedef TreeNode value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef TreeNode * pointer;
+                typedef TreeNode & reference;
+
+                iterator() {
+                    node = NULL;
+                    tree = NULL;
+                };
+
+                TreeNode & operator*() const {
+                    return *node;
+                };
+
+                TreeNode * operator->() const {
+                    return node;
+                };
+
+                // Amortized constant time, O(1).
+                iterator & operator++() {
+                    node = successor(node);
+                    return *this;
+                };
+
+                iterator operator++(int) {
+                    iterator it = *this;
+                    ++(*this);
+                    return it;
+                };
+
+                // Decrementing end() gives the node with the largest key.
+                // Amortized constant time, O(1).
+                iterator & operator--() {
+                    if (node)
+                        node = predecessor(node);
+                    else
+                        node = maximum(tree->root);
+                    return *this;
+                };
+
+                iterator operator--(int) {
+                    iterator it = *this;
+                    --(*this);
+                    return it;
+                };
+
+                bool operator==(const iterator & other) const {
+                    return node == other.node;
+                };
+
+                bool operator!=(const iterator & other) const {
+                    return node != other.node;
+                };
+        };
+
+        Tree() {};
+
+    protected:
+        // Lets the trees create iterators and look inside them.
+        iterator make_iterator(TreeNode * x) {
+            return iterator(x, this);
+        };
+
+        static TreeNode * node_of(const iterator & it) {
+            return it.node;
+        };
+
+    public:
+
+        Tree(const Tree & other) {
+            this->root = copy_subtree(other.root, NULL);
+        };
+
+        Tree(Tree && other) {
+            std::swap(this->root, other.root);
+            this->pool.swap(other.pool);
+        };
+
+        Tree & operator=(const Tree & other) {
+            if (this != &other) {
+                clear();
+                this->root = copy_subtree(other.root, NULL);
+            }
+            return *this;
+        };
+
+        Tree & operator=(Tree && other) {
+            std::swap(this->root, other.root);
+            this->pool.swap(other.pool);
+            return *this;
+        };
+
+        virtual ~Tree() {
+            clear();
+        };
+
         virtual void insert(TKey key, TValue value) = 0;
 
+        // Replaces the contents of the tree with the n given keys and values.
+        // The keys must be sorted. All nodes are allocated in one go and the
+        // tree is built balanced (and correctly colored) without a single
+        // key comparison.
+        // Linear time, O(n).
+        void build(const TKey keys[], const TValue values[], long n) {
+            long i = 0;
+            build_tree([&]() {
+                TreeNode * x = create_node(keys[i], values[i]);
+                i++;
+                return x;
+            }, n);
+        };
+
+        // Same as above, but for a sorted range of pairs, like the ones in a
+        // std::map or a sorted std::vector of std::pair.
+        // Linear time, O(n).
+        template<class TIterator>
+        void build(TIterator first, TIterator last) {
+            build_tree([&]() {
+                TreeNode * x = create_node(first->first, first->second);
+                ++first;
+                return x;
+            }, (long)std::distance(first, last));
+        };
+
+        // Removes all nodes from the tree.
+        // If the keys and values need no destructor, the memory is given
+        // back slab by slab without visiting the nodes. Otherwise every node
+        // is destroyed first, which is linear time, O(n).
+        void clear() {
+            destroy_subtree(this->root);
+            this->pool.clear();
+            this->root = NULL;
+        };
+
         // Prints all nodes in tree.
         // Linear time, O(n).
         std::string inorder_tree_walk() {
@@ -79,17 +449,91 @@ class Tree {
         };
 
         // Prints all nodes in the subtree of x in order.
+        // The nodes are visited without recursion and everything is written
+        // to a single stream.
         // Linear time, O(n).
         std::string inorder_tree_walk(TreeNode * x) {
             std::ostringstream os;
             if (x) {
-                os << inorder_tree_walk(x->left);
-                os << to_string(x->key) + ": " + to_string(x->value) << std::endl;
-                os << inorder_tree_walk(x->right);
+                TreeNode * last = maximum(x);
+                for (TreeNode * y = minimum(x); ; y = successor(y)) {
+                    os << y->key << ": " << y->value << std::endl;
+                    if (y == last)
+                        break;
+                }
             }
             return os.str();
         };
 
+        // Returns an iterator to the node with the smallest key.
+        iterator begin() {
+            return iterator(this->root ? minimum(this->root) : NULL, this);
+        };
+
+        // Returns an iterator to one past the node with the largest key.
+        iterator end() {
+            return iterator(NULL, this);
+        };
+
+        // Returns an iterator to a node with the key k, or end() if there is
+        // no such node.
+        // If the height of the tree is h, this operation is O(h).
+        iterator find(TKey k) {
+            iterator it = lower_bound(k);
+            if (it.node && !(k < it.node->key))
+                return it;
+            return end();
+        };
+
+        // Returns an iterator to the first node whose key is not less than k.
+        // If the height of the tree is h, this operation is O(h).
+        iterator lower_bound(TKey k) {
+            TreeNode * x = this->root;
+            TreeNode * y = NULL;
+            while (x) {
+                if (x->key < k)
+                    x = x->right;
+                else {
+                    y = x;
+                    x = x->left;
+                }
+            }
+            return iterator(y, this);
+        };
+
+        // Returns an iterator to the first node whose key is greater than k.
+        // If the height of the tree is h, this operation is O(h).
+        iterator upper_bound(TKey k) {
+            TreeNode * x = this->root;
+            TreeNode * y = NULL;
+            while (x) {
+                if (k < x->key) {
+                    y = x;
+                    x = x->left;
+                }
+                else
+                    x = x->right;
+            }
+            return iterator(y, this);
+        };
+
+        // Returns the range of nodes with the key k.
+        // If the height of the tree is h, this operation is O(h).
+        std::pair<iterator, iterator> equal_range(TKey k) {
+            return std::make_pair(lower_bound(k), upper_bound(k));
+        };
+
+        // Calls visit(key, value) for every node with a key in [lo, hi], in
+        // order. Nothing is allocated along the way.
+        // If the height of the tree is h and m nodes are visited, this
+        // operation is O(h + m).
+        template<class TVisitor>
+        void range_scan(TKey lo, TKey hi, TVisitor visit) {
+            for (TreeNode * x = lower_bound(lo).node; x && !(hi < x->key);
+                 x = successor(x))
+                visit(x->key, x->value);
+        };
+
         // Searches (recursively) for a specific key in the subtree of x.
         // If the height of the tree is h, this operation is O(h).
         // Adapated from Cormen et. al., section 12.2
@@ -108,6 +552,7 @@ class Tree {
         }
 
         // Searches (iteratively) for a specific key in the subtree of x.
+        // Returns a default value if k is not in the tree.
         // If the height of the tree is h, this operation is O(h). 
         // Adapted from Cormen et. al., section 12.2
         TValue iterative_tree_search(TKey k) {
@@ -118,8 +563,7 @@ class Tree {
                 else
                     x = x->right;
             }
-            if (x)
-                return x->value;
+            return x ? x->value : TValue();
         };
 
         // Searches for a specific node in the subtree of x and returns the
@@ -157,18 +601,84 @@ class Tree {
             return x->key;
         }
 
-        // Finds the height of the tree.
-        // This operation is O(n). A better way is to store the height.
-        // Something for the future :-)
+        // Returns the height of the tree.
+        // The height is stored in every node and kept up to date, so this
+        // operation is O(1).
         int height() {
             return height(this->root);
         }
 
         int height(TreeNode * x) {
-            if (!x)
-                return -1;
-            else
-                return std::max(height(x->left), height(x->right)) + 1;
+            return x ? x->height : -1;
+        }
+
+        // Returns the number of nodes in the tree.
+        // Constant time, O(1).
+        long size() {
+            return size(this->root);
+        }
+
+        // Returns the i'th smallest key in the tree, counting from 1.
+        // i must be between 1 and size().
+        // If the height of the tree is h, this operation is O(h).
+        // Adapted from Cormen et. al., section 14.1
+        TKey select(long i) {
+            TreeNode * x = this->root;
+            while (x) {
+                long r = size(x->left) + 1;
+                if (i == r)
+                    break;
+                if (i < r)
+                    x = x->left;
+                else {
+                    x = x->right;
+                    i -= r;
+                }
+            }
+            return x->key;
+        }
+
+        // Returns the number of keys in the tree that are less than or equal
+        // to k. If k is in the tree (once), this is its position in order,
+        // counting from 1, so select(rank(k)) == k.
+        // If the height of the tree is h, this operation is O(h).
+        // Adapted from Cormen et. al., section 14.1
+        long rank(TKey k) {
+            TreeNode * x = this->root;
+            long r = 0;
+            while (x) {
+                if (k < x->key)
+                    x = x->left;
+                else {
+                    r += size(x->left) + 1;
+                    x = x->right;
+                }
+            }
+            return r;
+        }
+
+        // Returns the number of keys in the tree that are less than k.
+        // If the height of the tree is h, this operation is O(h).
+        long count_less(TKey k) {
+            TreeNode * x = this->root;
+            long r = 0;
+            while (x) {
+                if (x->key < k) {
+                    r += size(x->left) + 1;
+                    x = x->right;
+                }
+                else
+                    x = x->left;
+            }
+            return r;
+        }
+
+        // Returns the number of keys in [lo, hi].
+        // If the height of the tree is h, this operation is O(h).
+        long count_range(TKey lo, TKey hi) {
+            if (hi < lo)
+                return 0;
+            return rank(hi) - count_less(lo);
         }
 };
 